@@ -0,0 +1,214 @@
+#ifndef __SYLAR_CHANNEL_H__
+#define __SYLAR_CHANNEL_H__
+
+#include <memory>
+#include <vector>
+#include "fiber_sync.h"
+#include "macro.h"
+
+namespace sylar {
+
+//有界的多生产者多消费者通道，满了push挂起，空了pop挂起，挂起的是协程，不阻塞工作线程，
+//close之后push都失败，pop把剩下的取完之后失败，
+template<class T>
+class Channel : public Noncopyable {
+public:
+    typedef std::shared_ptr<Channel> ptr;
+    typedef Spinlock MutexType;
+
+    Channel(size_t capacity)
+        :m_buffer(capacity)
+        ,m_capacity(capacity) {
+        SYLAR_ASSERT(capacity > 0);
+    }
+
+    bool push(const T& v) {
+        T tmp(v);
+        return push(std::move(tmp));
+    }
+
+    bool push(T&& v) {
+        m_mutex.lock();
+        while(m_size == m_capacity && !m_closed) {
+            m_notFull.wait(m_mutex);
+            m_mutex.lock();
+        }
+        if(m_closed) {
+            m_mutex.unlock();
+            return false;
+        }
+        put(std::move(v));
+        FiberWaiter* w = m_notEmpty.pop();
+        m_mutex.unlock();
+        if(w) {
+            w->wake();
+        }
+        return true;
+    }
+
+    //满了或者关闭了返回false，不挂起，
+    bool tryPush(T&& v) {
+        m_mutex.lock();
+        if(m_size == m_capacity || m_closed) {
+            m_mutex.unlock();
+            return false;
+        }
+        put(std::move(v));
+        FiberWaiter* w = m_notEmpty.pop();
+        m_mutex.unlock();
+        if(w) {
+            w->wake();
+        }
+        return true;
+    }
+
+    bool pop(T& v) {
+        m_mutex.lock();
+        while(m_size == 0 && !m_closed) {
+            m_notEmpty.wait(m_mutex);
+            m_mutex.lock();
+        }
+        if(m_size == 0) {   //关闭了并且取完了，
+            m_mutex.unlock();
+            return false;
+        }
+        take(v);
+        FiberWaiter* w = m_notFull.pop();
+        m_mutex.unlock();
+        if(w) {
+            w->wake();
+        }
+        return true;
+    }
+
+    //空了返回false，不挂起，
+    bool tryPop(T& v) {
+        m_mutex.lock();
+        if(m_size == 0) {
+            m_mutex.unlock();
+            return false;
+        }
+        take(v);
+        FiberWaiter* w = m_notFull.pop();
+        m_mutex.unlock();
+        if(w) {
+            w->wake();
+        }
+        return true;
+    }
+
+    //把items全部放进通道(里面的元素被move走)，满了就挂起等待，返回放进去的个数，
+    //只有通道中途关闭时才会少于items.size()，
+    size_t pushBatch(std::vector<T>& items) {
+        size_t pushed = 0;
+        while(pushed < items.size()) {
+            m_mutex.lock();
+            while(m_size == m_capacity && !m_closed) {
+                m_notFull.wait(m_mutex);
+                m_mutex.lock();
+            }
+            if(m_closed) {
+                m_mutex.unlock();
+                break;
+            }
+            size_t n = 0;
+            while(m_size < m_capacity && pushed < items.size()) {
+                put(std::move(items[pushed++]));
+                ++n;
+            }
+            FiberWaitQueue woken = popWaiters(m_notEmpty, n);
+            m_mutex.unlock();
+            wakeAll(woken);
+        }
+        return pushed;
+    }
+
+    //至少取到一个(空了就挂起)，最多取max个追加到out，返回取到的个数，关闭并且取完了返回0，
+    size_t popBatch(std::vector<T>& out, size_t max) {
+        m_mutex.lock();
+        while(m_size == 0 && !m_closed) {
+            m_notEmpty.wait(m_mutex);
+            m_mutex.lock();
+        }
+        size_t n = 0;
+        while(m_size > 0 && n < max) {
+            out.emplace_back();
+            take(out.back());
+            ++n;
+        }
+        FiberWaitQueue woken = popWaiters(m_notFull, n);
+        m_mutex.unlock();
+        wakeAll(woken);
+        return n;
+    }
+
+    //唤醒所有等待的协程，
+    void close() {
+        m_mutex.lock();
+        m_closed = true;
+        FiberWaitQueue readers = m_notEmpty;
+        FiberWaitQueue writers = m_notFull;
+        m_notEmpty = FiberWaitQueue();
+        m_notFull = FiberWaitQueue();
+        m_mutex.unlock();
+        wakeAll(readers);
+        wakeAll(writers);
+    }
+
+    bool isClosed() {
+        MutexType::Lock lock(m_mutex);
+        return m_closed;
+    }
+
+    size_t size() {
+        MutexType::Lock lock(m_mutex);
+        return m_size;
+    }
+
+    size_t capacity() const { return m_capacity;}
+
+private:
+    void put(T&& v) {
+        m_buffer[(m_head + m_size) % m_capacity] = std::move(v);
+        ++m_size;
+    }
+
+    void take(T& v) {
+        v = std::move(m_buffer[m_head]);
+        m_buffer[m_head] = T();     //不留着已经取走的对象(比如shared_ptr)，
+        m_head = (m_head + 1) % m_capacity;
+        --m_size;
+    }
+
+    static FiberWaitQueue popWaiters(FiberWaitQueue& queue, size_t n) {
+        FiberWaitQueue woken;
+        for(; n > 0; --n) {
+            FiberWaiter* w = queue.pop();
+            if(!w) {
+                break;
+            }
+            woken.push(w);
+        }
+        return woken;
+    }
+
+    static void wakeAll(FiberWaitQueue& woken) {
+        while(FiberWaiter* w = woken.pop()) {
+            w->wake();
+        }
+    }
+
+private:
+    MutexType m_mutex;
+    std::vector<T> m_buffer;
+    size_t m_capacity;
+    size_t m_head = 0;
+    size_t m_size = 0;
+    bool m_closed = false;
+    FiberWaitQueue m_notEmpty;      //等数据的消费者
+    FiberWaitQueue m_notFull;       //等空位的生产者
+};
+
+}
+
+#endif
@@ -8,8 +8,11 @@
 
 namespace sylar {
 
+//从1开始，0表示fd没有被FdMgr管理，
+static std::atomic<uint64_t> s_fd_generation = {0};
 
-FdCtx::FdCtx(int fd) 
+
+FdCtx::FdCtx(int fd, bool nonblock_socket) 
     :m_isInit(false)
     ,m_isSocket(false)
     ,m_sysNonblock(false)
@@ -17,8 +20,15 @@ FdCtx::FdCtx(int fd)
     ,m_isClosed(false)
     ,m_fd(fd)
     ,m_recvTimeout(-1)
-    ,m_sendTimeout(-1){
-        init();  //调用init函数里面判断fd是不是socket，
+    ,m_sendTimeout(-1)
+    ,m_generation(++s_fd_generation){
+    if(nonblock_socket) {   //省掉fstat和fcntl两次系统调用，
+        m_isInit = true;
+        m_isSocket = true;
+        m_sysNonblock = true;
+        return;
+    }
+    init();  //调用init函数里面判断fd是不是socket，
 }
 
 FdCtx::~FdCtx(){
@@ -82,40 +92,55 @@ uint64_t FdCtx::getTimeout(int type) {
 
 
 FdManager::FdManager() {
-    m_datas.resize(64);
 }
 
-FdCtx::ptr FdManager::get(int fd, bool auto_create){
-    if(fd == -1) {
+FdCtx::ptr FdManager::get(int fd, bool auto_create, bool nonblock_socket){
+    if(fd < 0) {
         return nullptr;
     }
-    RWMutexType::Readlock lock(m_mutex);
-    if((int)m_datas.size() < fd) {
-        if(auto_create == false) {   //本来fd就已经比m_datas的空间大了，所以肯定次fd没有被FdMgr管理，并且此时还不自动创建，那么就返回nullptr
-            return nullptr;
-        }
-    } else {
-        if(m_datas[fd] || !auto_create) {   //此fd已经被FdMgr管理了，
-            return m_datas[fd];
-        }
+    FdCtx::ptr* slot = m_datas.at(fd, auto_create);
+    if(!slot) {     //fd所在的段还没有分配，并且此时还不自动创建，那么肯定没有被FdMgr管理，
+        return nullptr;
+    }
+    FdCtx::ptr ctx = std::atomic_load(slot);
+    if(ctx || !auto_create) {   //此fd已经被FdMgr管理了，
+        return ctx;
     }
-    lock.unlock();
 
-    RWMutexType::WriteLock lock2(m_mutex);
-    FdCtx::ptr ctx(new FdCtx(fd));
-    m_datas[fd] = ctx;
-    return ctx;
+    FdCtx::ptr created(new FdCtx(fd, nonblock_socket));
+    if(!std::atomic_compare_exchange_strong(slot, &ctx, created)) {
+        return ctx;     //其他线程先创建了，
+    }
+    return created;
+}
+
+FdCtx::ptr FdManager::create(int fd, bool nonblock_socket) {
+    if(fd < 0) {
+        return nullptr;
+    }
+    FdCtx::ptr* slot = m_datas.at(fd, true);
+    if(!slot) {
+        return nullptr;
+    }
+    FdCtx::ptr created(new FdCtx(fd, nonblock_socket));
+    std::atomic_store(slot, created);
+    return created;
+}
+
+uint64_t FdManager::getGeneration(int fd) {
+    FdCtx::ptr ctx = get(fd);
+    return ctx ? ctx->getGeneration() : 0;
 }
 
 void FdManager::del(int fd) {
-    if(fd == -1) {
+    if(fd < 0) {
         return;
     }
-    RWMutexType::WriteLock lock(m_mutex);
-    if((int)m_datas.size() <= fd) {
+    FdCtx::ptr* slot = m_datas.at(fd);
+    if(!slot) {
         return;
     }
-    m_datas[fd].reset();
+    std::atomic_store(slot, FdCtx::ptr());
 }
 
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "thread.h"
 #include <vector>
 #include "singleton.h"
+#include "segmented_table.h"
 
 
 namespace sylar {
@@ -12,7 +13,8 @@ namespace sylar {
 class FdCtx : public std::enable_shared_from_this<FdCtx> {
 public:
     typedef std::shared_ptr<FdCtx> ptr;
-    FdCtx(int fd);
+    //nonblock_socket为true表示调用者已经知道fd是非阻塞的socket(比如accept4带了SOCK_NONBLOCK)，
+    FdCtx(int fd, bool nonblock_socket = false);
     ~FdCtx();
 
     bool init();
@@ -30,6 +32,9 @@ public:
     void setTimeout(int type, uint64_t v);
     uint64_t getTimeout(int type);
 
+    //每个FdCtx创建时分配一个全局递增的代数，fd号被复用时新的FdCtx代数一定不同，
+    uint64_t getGeneration() const { return m_generation; }
+
 private:
     bool m_isInit: 1;
     bool m_isSocket: 1;
@@ -39,21 +44,25 @@ private:
     int m_fd;
     uint64_t m_recvTimeout;
     uint64_t m_sendTimeout;
+    uint64_t m_generation;
 
 
 };
 
 
+//fd表用分段表，查找不加锁，每个槽里的FdCtx::ptr用std::atomic_load/atomic_store读写，
 class FdManager {
 public:
-    typedef RWMutex RWMutexType;
     FdManager();
 
-    FdCtx::ptr get(int fd, bool auto_create = false);
+    FdCtx::ptr get(int fd, bool auto_create = false, bool nonblock_socket = false);
+    //fd是刚由socket/accept/accept4得到的，不管槽里有没有旧的FdCtx(fd关闭时没有经过hook的close)都换成新的，
+    FdCtx::ptr create(int fd, bool nonblock_socket = false);
+    //fd当前FdCtx的代数，没有被FdMgr管理时返回0，
+    uint64_t getGeneration(int fd);
     void del(int fd);
 private:
-    RWMutexType m_mutex;
-    std::vector<FdCtx::ptr> m_datas;
+    SegmentedTable<FdCtx::ptr> m_datas;
 };
 
 typedef Singleton<FdManager> FdMgr;
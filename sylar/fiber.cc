@@ -3,6 +3,9 @@
 #include "macro.h"
 #include "log.h"
 #include <atomic>
+#include <unordered_map>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "util.h"
 
 
@@ -21,6 +24,67 @@ static thread_local Fiber::ptr t_threadFiber = nullptr;
 static sylar::ConfigVar<uint32_t>::ptr g_fiber_stack_size = 
     sylar::Config::Lookup<uint32_t>("fiber.stack_size",1024*1024,"fiber stack size");
 
+//每个线程最多缓存多少个空闲的协程栈，0表示不缓存
+static sylar::ConfigVar<uint32_t>::ptr g_fiber_stack_pool_size = 
+    sylar::Config::Lookup<uint32_t>("fiber.stack_pool_size", 64, "fiber stack pool size per thread");
+
+//每个线程最多缓存多少个执行结束的协程，0表示不缓存
+static sylar::ConfigVar<uint32_t>::ptr g_fiber_free_list_size = 
+    sylar::Config::Lookup<uint32_t>("fiber.free_list_size", 128, "terminated fiber free list size per thread");
+
+//协程栈的物理内存优先分配在创建它的线程所在的numa节点上，配合scheduler.cpu_affinity使用，
+static sylar::ConfigVar<bool>::ptr g_fiber_numa_local =
+    sylar::Config::Lookup<bool>("fiber.numa_local", false, "bind fiber stacks to local numa node");
+
+//配置的镜像，监听器在任意线程写，工作线程读，用relaxed原子变量，
+static std::atomic<uint32_t> s_stack_size {1024 * 1024};
+static std::atomic<uint32_t> s_stack_pool_size {64};
+static std::atomic<uint32_t> s_free_list_size {128};
+static size_t s_page_size = 4096;
+static std::atomic<bool> s_numa_local {false};
+
+static std::atomic<uint64_t> s_pool_hits {0};
+static std::atomic<uint64_t> s_pool_misses {0};
+
+namespace {
+struct _FiberIniter {
+    _FiberIniter() {
+        long page = sysconf(_SC_PAGESIZE);
+        if(page > 0) {
+            s_page_size = page;
+        }
+        s_stack_size.store(g_fiber_stack_size->getValue(), std::memory_order_relaxed);
+        s_stack_pool_size.store(g_fiber_stack_pool_size->getValue(), std::memory_order_relaxed);
+        s_free_list_size.store(g_fiber_free_list_size->getValue(), std::memory_order_relaxed);
+        s_numa_local.store(g_fiber_numa_local->getValue(), std::memory_order_relaxed);
+
+        g_fiber_stack_size->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            s_stack_size.store(new_value, std::memory_order_relaxed);
+        });
+        g_fiber_stack_pool_size->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            SYLAR_LOG_INFO(g_logger) << "fiber stack pool size changed from "
+                << old_value << " to " << new_value;
+            s_stack_pool_size.store(new_value, std::memory_order_relaxed);
+        });
+        g_fiber_numa_local->addListener([](const bool& old_value, const bool& new_value){
+            s_numa_local.store(new_value, std::memory_order_relaxed);
+        });
+        g_fiber_free_list_size->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            SYLAR_LOG_INFO(g_logger) << "fiber free list size changed from "
+                << old_value << " to " << new_value;
+            s_free_list_size.store(new_value, std::memory_order_relaxed);
+        });
+    }
+};
+static _FiberIniter s_fiber_initer;
+}
+
+//本线程执行结束(TERM/EXCEPT)的协程，Fiber::Create优先从这里取，
+static std::vector<Fiber::ptr>& GetFreeList() {
+    static thread_local std::vector<Fiber::ptr> s_free_list;
+    return s_free_list;
+}
+
 class MallocStackAllocator {
 public:
     static void* Alloc(size_t size){
@@ -32,7 +96,90 @@ public:
     }
 
 };
-using StackAllocator = MallocStackAllocator;
+
+//mmap分配协程栈，栈底(低地址)多映射一页PROT_NONE的保护页，栈溢出时直接触发SIGSEGV，而不是踩坏堆，
+//释放的栈按大小缓存在本线程的池子里，下次分配直接复用，
+class MmapStackAllocator {
+public:
+    static void* Alloc(size_t size){
+        StackPool* pool = GetPool();
+        if(pool) {
+            auto it = pool->stacks.find(size);
+            if(it != pool->stacks.end() && !it->second.empty()) {
+                void* vp = it->second.back();
+                it->second.pop_back();
+                --pool->count;
+                return vp;
+            }
+        }
+
+        size_t len = size + s_page_size;
+        void* base = mmap(nullptr, len, PROT_READ | PROT_WRITE
+                        , MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(base == MAP_FAILED) {
+            SYLAR_LOG_ERROR(g_logger) << "mmap fiber stack size=" << size
+                << " errno=" << errno << " errstr=" << strerror(errno);
+            return nullptr;
+        }
+        if(mprotect(base, s_page_size, PROT_NONE)) {
+            SYLAR_LOG_ERROR(g_logger) << "mprotect guard page errno=" << errno
+                << " errstr=" << strerror(errno);
+        }
+        //只是第一次映射时的放置提示：协程被其他线程偷走、回收或者在其他线程释放时，
+        //栈会跟着到别的线程(和它的池子)里，不保证一直在本地节点上，
+        if(s_numa_local.load(std::memory_order_relaxed)) {
+            BindToLocalNode((char*)base + s_page_size, size);
+        }
+        return (char*)base + s_page_size;
+    }
+
+    static void Dealloc(void* vp, size_t size){
+        if(!vp) {
+            return;
+        }
+        StackPool* pool = GetPool();
+        if(pool && pool->count < s_stack_pool_size.load(std::memory_order_relaxed)) {
+            pool->stacks[size].push_back(vp);
+            ++pool->count;
+            return;
+        }
+        Unmap(vp, size);
+    }
+
+private:
+    struct StackPool {
+        std::unordered_map<size_t, std::vector<void*> > stacks;
+        uint32_t count = 0;
+
+        ~StackPool() {
+            for(auto& i : stacks) {
+                for(auto& vp : i.second) {
+                    Unmap(vp, i.first);
+                }
+            }
+            t_pool_state = 2;
+        }
+    };
+
+    static void Unmap(void* vp, size_t size) {
+        munmap((char*)vp - s_page_size, size + s_page_size);
+    }
+
+    //线程退出时池子先析构，之后再释放的栈直接munmap，
+    static StackPool* GetPool() {
+        if(t_pool_state == 2) {
+            return nullptr;
+        }
+        static thread_local StackPool s_pool;
+        t_pool_state = 1;
+        return &s_pool;
+    }
+
+    static thread_local int t_pool_state;
+};
+thread_local int MmapStackAllocator::t_pool_state = 0;
+
+using StackAllocator = MmapStackAllocator;
 
 uint64_t Fiber::GetFiberId(){
     if(t_fiber){
@@ -48,34 +195,24 @@ Fiber::Fiber() {
     m_state = EXEC;
     SetThis(this);
 
-    if(getcontext(&m_ctx)){
-        SYLAR_ASSERT2(false,"getcontext");
-    }
+    InitFiberContext(&m_ctx);
     ++s_fiber_count;
 
     SYLAR_LOG_INFO(g_logger) <<"Fiber::Fiber()";
 }
 
 
-Fiber::Fiber(std::function<void()> cb, size_t stacksize = 0,bool use_caller)
+Fiber::Fiber(Task cb, size_t stacksize = 0,bool use_caller)
     :m_id(++s_fiber_id)
-    ,m_cb(cb){
+    ,m_cb(std::move(cb)){
     ++s_fiber_count;
-    m_stacksize = stacksize ? stacksize : g_fiber_stack_size->getValue();
+    m_stacksize = stacksize ? stacksize : s_stack_size.load(std::memory_order_relaxed);
 
     m_stack = StackAllocator::Alloc(m_stacksize);
-    if(getcontext(&m_ctx)){      //getcontext()函数的作用：初始化ucp结构体，将当前上下文保存在ucp中，
-        SYLAR_ASSERT2(false, "getcontext");
-    }
-    m_ctx.uc_link = nullptr; //这个uc_link，意思是，当前上下文执行结束后，需要切换到的另一个上下文，如果是nullptr，执行完该协程后，线程就退出，
-    m_ctx.uc_stack.ss_sp = m_stack;    //该上下文使用的栈，
-    m_ctx.uc_stack.ss_size = m_stacksize;
-
-    if(!use_caller){
-        makecontext(&m_ctx, &Fiber::MainFunc, 0); //makecontext函数执行之前，一定要执行一次getcontext，makecontext()函数的作用：将ucp对应的上下文的指令地址指向func函数(协程)地址，argc是func的参数，
-    } else {
-        makecontext(&m_ctx, &Fiber::CallerMainFunc, 0); 
-    }
+    SYLAR_ASSERT2(m_stack, "alloc fiber stack fail");
+    //切换进来的时候执行MainFunc(协程)，use_caller的协程执行完后要回到线程的主协程，
+    MakeFiberContext(&m_ctx, m_stack, m_stacksize
+            , use_caller ? &Fiber::CallerMainFunc : &Fiber::MainFunc);
 
     SYLAR_LOG_INFO(g_logger) <<"Fiber::Fiber id=" << m_id;
 
@@ -101,34 +238,60 @@ Fiber::~Fiber(){
 
 //重置协程函数，并且重置状态，
 //INIT， 
-void Fiber::reset(std::function<void()> cb){
+void Fiber::reset(Task cb){
     SYLAR_ASSERT(m_stack);
     SYLAR_ASSERT(m_state == TERM || m_state == INIT || m_state == EXCEPT);
-    m_cb = cb;
-    if(getcontext(&m_ctx)){
-        SYLAR_ASSERT2(false ,"getcontxt");
+    m_cb = std::move(cb);
+    MakeFiberContext(&m_ctx, m_stack, m_stacksize, &Fiber::MainFunc);
+    m_state = INIT;
+}
+
+Fiber::ptr Fiber::Create(Task cb){
+    std::vector<Fiber::ptr>& free_list = GetFreeList();
+    if(!free_list.empty()){
+        Fiber::ptr fiber;
+        fiber.swap(free_list.back());
+        free_list.pop_back();
+        fiber->reset(std::move(cb));
+        ++s_pool_hits;
+        return fiber;
     }
+    ++s_pool_misses;
+    return Fiber::ptr(new Fiber(std::move(cb)));
+}
 
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stacksize;
-    
-    makecontext(&m_ctx, &Fiber::MainFunc, 0);
-    m_state = INIT;
+void Fiber::Recycle(Fiber::ptr& fiber){
+    if(!fiber || !fiber->m_stack
+            || fiber.use_count() > 1     //别的地方还持有这个协程，不能复用
+            || fiber->m_stacksize != s_stack_size.load(std::memory_order_relaxed)
+            || (fiber->m_state != TERM && fiber->m_state != EXCEPT)){
+        return;
+    }
+    std::vector<Fiber::ptr>& free_list = GetFreeList();
+    if(free_list.size() >= s_free_list_size.load(std::memory_order_relaxed)){
+        return;
+    }
+    fiber->m_cb = nullptr;    //尽早释放回调里持有的资源，
+    free_list.push_back(Fiber::ptr());
+    free_list.back().swap(fiber);
+}
+
+uint64_t Fiber::GetPoolHits(){
+    return s_pool_hits;
+}
+
+uint64_t Fiber::GetPoolMisses(){
+    return s_pool_misses;
 }
 
 void Fiber::call(){
     m_state = EXEC;
-    if(swapcontext(&t_threadFiber->m_ctx, &m_ctx)){
-        SYLAR_ASSERT2(false,"swapcontext");
-    }
+    SwapFiberContext(&t_threadFiber->m_ctx, &m_ctx);
 }
 
 void Fiber::back(){
     SetThis(t_threadFiber.get());
-    if(swapcontext(&m_ctx, &t_threadFiber->m_ctx)){
-        SYLAR_ASSERT2(false, "swapcontext");
-    }
+    SwapFiberContext(&m_ctx, &t_threadFiber->m_ctx);
 }
 
 //切换到当前协程执行
@@ -136,17 +299,13 @@ void Fiber::swapIn(){
     SetThis(this);
     SYLAR_ASSERT(m_state != EXEC);
     m_state = EXEC;
-    if(swapcontext(&Scheduler::GetMainFiber()->m_ctx,&m_ctx)){ 
-        SYLAR_ASSERT2(false,"swapcontext");
-    }   
+    SwapFiberContext(&Scheduler::GetMainFiber()->m_ctx, &m_ctx);
     
 }
 //切换到后台执行
 void Fiber::swapOut(){
     SetThis(Scheduler::GetMainFiber());
-    if(swapcontext(&m_ctx, &Scheduler::GetMainFiber()->m_ctx)){
-        SYLAR_ASSERT2(false,"swapcontext");
-    }
+    SwapFiberContext(&m_ctx, &Scheduler::GetMainFiber()->m_ctx);
 }
 
 
@@ -2,7 +2,8 @@
 #define __SYLAR_FIBER_H__
 
 #include <memory>
-#include <ucontext.h>
+#include "fiber_context.h"
+#include "task.h"
 #include <functional>
 #include "thread.h"
 #include "scheduler.h"
@@ -30,12 +31,12 @@ private:
     Fiber();
 
 public:
-    Fiber(std::function<void()> cb, size_t stacksize = 0, bool use_caller = false);
+    Fiber(Task cb, size_t stacksize = 0, bool use_caller = false);
     ~Fiber();
 
     //重置协程函数，并且重置状态，
     //INIT， TEMM
-    void reset(std::function<void()> cb);
+    void reset(Task cb);
     //切换到当前协程执行， 主协程切换为子协程执行，
     void swapIn();
     //切换到后台执行， 当前正在执行的子协程切换为主协程
@@ -65,6 +66,14 @@ public:
 
     static uint64_t GetFiberId();
 
+    //优先复用本线程空闲链表里执行结束的协程(reset)，没有才新建，
+    static Fiber::ptr Create(Task cb);
+    //执行结束(TERM/EXCEPT)且没有其他地方引用的协程放回本线程的空闲链表，放回后fiber被置空，
+    static void Recycle(Fiber::ptr& fiber);
+    //Create命中/未命中空闲链表的次数，
+    static uint64_t GetPoolHits();
+    static uint64_t GetPoolMisses();
+
 
 
 private:
@@ -72,10 +81,10 @@ private:
     uint32_t m_stacksize = 0;
     State m_state = INIT;
 
-    ucontext_t m_ctx;
+    FiberContext m_ctx;
     void* m_stack = nullptr;
 
-    std::function<void()> m_cb;
+    Task m_cb;
 };
 
 
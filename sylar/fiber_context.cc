@@ -0,0 +1,173 @@
+#include "fiber_context.h"
+#include <stdint.h>
+#include <string.h>
+#include "log.h"
+#include "macro.h"
+
+namespace sylar {
+
+#if defined(SYLAR_FIBER_ASM)
+
+extern "C" {
+//把callee-saved寄存器压到当前栈上，栈顶保存到*from_sp，然后切到to_sp的栈上恢复寄存器并返回，
+void sylar_fiber_swap(void** from_sp, void* to_sp);
+//新协程第一次被切换进来时，从这里开始执行，入口函数保存在callee-saved寄存器里，
+void sylar_fiber_entry();
+}
+
+#if defined(__x86_64__)
+//栈上的布局(从低地址到高地址)：mxcsr(4) fpu_cw(2) pad(2) r12 r13 r14 r15 rbx rbp 返回地址
+asm(R"(
+    .text
+    .globl sylar_fiber_swap
+    .type sylar_fiber_swap,@function
+    .align 16
+sylar_fiber_swap:
+    pushq %rbp
+    pushq %rbx
+    pushq %r15
+    pushq %r14
+    pushq %r13
+    pushq %r12
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r12
+    popq %r13
+    popq %r14
+    popq %r15
+    popq %rbx
+    popq %rbp
+    ret
+    .size sylar_fiber_swap,.-sylar_fiber_swap
+
+    .globl sylar_fiber_entry
+    .type sylar_fiber_entry,@function
+    .align 16
+sylar_fiber_entry:
+    callq *%rbx
+    ud2
+    .size sylar_fiber_entry,.-sylar_fiber_entry
+)");
+
+static const size_t s_frame_size = 64;
+
+void MakeFiberContext(FiberContext* ctx, void* stack, size_t size, void (*fn)()) {
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+    //ret之后rsp刚好16字节对齐，call入口函数时满足ABI要求，
+    uint64_t* frame = (uint64_t*)(top - s_frame_size);
+    memset(frame, 0, s_frame_size);
+    uint32_t mxcsr = 0x1F80;
+    uint16_t fpu_cw = 0x037F;
+    memcpy((char*)frame, &mxcsr, sizeof(mxcsr));
+    memcpy((char*)frame + 4, &fpu_cw, sizeof(fpu_cw));
+    frame[5] = (uint64_t)fn;                    //rbx
+    frame[7] = (uint64_t)&sylar_fiber_entry;    //返回地址
+    ctx->sp = frame;
+}
+
+#elif defined(__aarch64__)
+//栈上的布局(从低地址到高地址)：d8-d15 x19-x28 x29 x30
+asm(R"(
+    .text
+    .global sylar_fiber_swap
+    .type sylar_fiber_swap,%function
+    .align 4
+sylar_fiber_swap:
+    sub sp, sp, #0xa0
+    stp d8, d9, [sp, #0x00]
+    stp d10, d11, [sp, #0x10]
+    stp d12, d13, [sp, #0x20]
+    stp d14, d15, [sp, #0x30]
+    stp x19, x20, [sp, #0x40]
+    stp x21, x22, [sp, #0x50]
+    stp x23, x24, [sp, #0x60]
+    stp x25, x26, [sp, #0x70]
+    stp x27, x28, [sp, #0x80]
+    stp x29, x30, [sp, #0x90]
+    mov x9, sp
+    str x9, [x0]
+    mov sp, x1
+    ldp d8, d9, [sp, #0x00]
+    ldp d10, d11, [sp, #0x10]
+    ldp d12, d13, [sp, #0x20]
+    ldp d14, d15, [sp, #0x30]
+    ldp x19, x20, [sp, #0x40]
+    ldp x21, x22, [sp, #0x50]
+    ldp x23, x24, [sp, #0x60]
+    ldp x25, x26, [sp, #0x70]
+    ldp x27, x28, [sp, #0x80]
+    ldp x29, x30, [sp, #0x90]
+    add sp, sp, #0xa0
+    ret
+    .size sylar_fiber_swap,.-sylar_fiber_swap
+
+    .global sylar_fiber_entry
+    .type sylar_fiber_entry,%function
+    .align 4
+sylar_fiber_entry:
+    blr x19
+    brk #0
+    .size sylar_fiber_entry,.-sylar_fiber_entry
+)");
+
+static const size_t s_frame_size = 0xa0;
+
+void MakeFiberContext(FiberContext* ctx, void* stack, size_t size, void (*fn)()) {
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+    uint64_t* frame = (uint64_t*)(top - s_frame_size);
+    memset(frame, 0, s_frame_size);
+    frame[8] = (uint64_t)fn;                    //x19
+    frame[19] = (uint64_t)&sylar_fiber_entry;   //x30
+    ctx->sp = frame;
+}
+#endif
+
+void InitFiberContext(FiberContext* ctx) {
+    ctx->sp = nullptr;    //第一次切出去的时候保存，
+}
+
+void SwapFiberContext(FiberContext* from, FiberContext* to) {
+    sylar_fiber_swap(&from->sp, to->sp);
+}
+
+const char* FiberContextBackend() {
+    return "asm";
+}
+
+#else
+
+void InitFiberContext(FiberContext* ctx) {
+    if(getcontext(&ctx->ctx)){
+        SYLAR_ASSERT2(false, "getcontext");
+    }
+}
+
+void MakeFiberContext(FiberContext* ctx, void* stack, size_t size, void (*fn)()) {
+    if(getcontext(&ctx->ctx)){      //makecontext函数执行之前，一定要执行一次getcontext，
+        SYLAR_ASSERT2(false, "getcontext");
+    }
+    ctx->ctx.uc_link = nullptr;
+    ctx->ctx.uc_stack.ss_sp = stack;
+    ctx->ctx.uc_stack.ss_size = size;
+    makecontext(&ctx->ctx, fn, 0);
+}
+
+void SwapFiberContext(FiberContext* from, FiberContext* to) {
+    if(swapcontext(&from->ctx, &to->ctx)){
+        SYLAR_ASSERT2(false, "swapcontext");
+    }
+}
+
+const char* FiberContextBackend() {
+    return "ucontext";
+}
+
+#endif
+
+}
@@ -0,0 +1,39 @@
+#ifndef __SYLAR_FIBER_CONTEXT_H__
+#define __SYLAR_FIBER_CONTEXT_H__
+
+#include <stddef.h>
+
+//协程上下文切换的实现，
+//x86_64和aarch64默认使用手写汇编，只保存/恢复callee-saved寄存器，不会像swapcontext一样每次切换都调用sigprocmask，
+//定义SYLAR_FIBER_UCONTEXT或者其他平台，使用ucontext，
+#if !defined(SYLAR_FIBER_UCONTEXT) && (defined(__x86_64__) || defined(__aarch64__))
+#   define SYLAR_FIBER_ASM 1
+#else
+#   include <ucontext.h>
+#endif
+
+namespace sylar {
+
+struct FiberContext {
+#if defined(SYLAR_FIBER_ASM)
+    void* sp = nullptr;   //切出去时的栈顶，寄存器都保存在栈上，
+#else
+    ucontext_t ctx;
+#endif
+};
+
+//初始化线程主协程的上下文，主协程使用线程自己的栈，
+void InitFiberContext(FiberContext* ctx);
+
+//在stack上构造一个新的上下文，第一次切换进来时执行fn，fn不能返回，
+void MakeFiberContext(FiberContext* ctx, void* stack, size_t size, void (*fn)());
+
+//保存当前上下文到from，切换到to，
+void SwapFiberContext(FiberContext* from, FiberContext* to);
+
+//当前使用的切换方式，"asm"或者"ucontext"
+const char* FiberContextBackend();
+
+}
+
+#endif
@@ -0,0 +1,157 @@
+#include "fiber_sync.h"
+#include "scheduler.h"
+
+namespace sylar {
+
+static void UnlockSpinlock(void* arg) {
+    ((Spinlock*)arg)->unlock();
+}
+
+void FiberWaiter::wake() {
+    if(sem) {
+        sem->notify();
+        return;
+    }
+    //先把需要的东西拿出来，schedule之后协程可能已经在别的线程上跑起来了，
+    Scheduler* s = scheduler;
+    Fiber::ptr f;
+    f.swap(fiber);
+    s->schedule(std::move(f));
+}
+
+void FiberWaitQueue::push(FiberWaiter* w) {
+    w->next = nullptr;
+    if(m_tail) {
+        m_tail->next = w;
+    } else {
+        m_head = w;
+    }
+    m_tail = w;
+}
+
+FiberWaiter* FiberWaitQueue::pop() {
+    FiberWaiter* w = m_head;
+    if(w) {
+        m_head = w->next;
+        if(!m_head) {
+            m_tail = nullptr;
+        }
+        w->next = nullptr;
+    }
+    return w;
+}
+
+void FiberWaitQueue::wait(Spinlock& lock) {
+    FiberWaiter waiter;
+    if(Scheduler::InTask()) {
+        waiter.scheduler = Scheduler::GetThis();
+        waiter.fiber = Fiber::GetThis();
+        push(&waiter);
+        Scheduler::Park(&UnlockSpinlock, &lock);
+    } else {
+        Semaphore sem;
+        waiter.sem = &sem;
+        push(&waiter);
+        lock.unlock();
+        sem.wait();
+    }
+}
+
+void FiberMutex::lock() {
+    m_mutex.lock();
+    if(!m_locked) {
+        m_locked = true;
+        m_mutex.unlock();
+        return;
+    }
+    m_waiters.wait(m_mutex);    //被唤醒时锁已经交到自己手里了，m_locked一直是true，
+}
+
+bool FiberMutex::trylock() {
+    Spinlock::Lock lock(m_mutex);
+    if(m_locked) {
+        return false;
+    }
+    m_locked = true;
+    return true;
+}
+
+void FiberMutex::unlock() {
+    m_mutex.lock();
+    FiberWaiter* w = m_waiters.pop();
+    if(!w) {
+        m_locked = false;
+    }
+    m_mutex.unlock();
+    if(w) {
+        w->wake();
+    }
+}
+
+void FiberCondVar::wait(FiberMutex& mutex) {
+    m_mutex.lock();
+    mutex.unlock();     //先进等待队列再放开mutex，中间的notify不会丢，
+    m_waiters.wait(m_mutex);
+    mutex.lock();
+}
+
+void FiberCondVar::notify_one() {
+    m_mutex.lock();
+    FiberWaiter* w = m_waiters.pop();
+    m_mutex.unlock();
+    if(w) {
+        w->wake();
+    }
+}
+
+void FiberCondVar::notify_all() {
+    m_mutex.lock();
+    FiberWaitQueue waiters = m_waiters;
+    m_waiters = FiberWaitQueue();
+    m_mutex.unlock();
+    while(FiberWaiter* w = waiters.pop()) {
+        w->wake();
+    }
+}
+
+FiberSemaphore::FiberSemaphore(uint32_t count)
+    :m_count(count) {
+}
+
+void FiberSemaphore::wait() {
+    m_mutex.lock();
+    if(m_count > 0) {
+        --m_count;
+        m_mutex.unlock();
+        return;
+    }
+    m_waiters.wait(m_mutex);    //notify直接把计数交给了自己，
+}
+
+bool FiberSemaphore::tryWait() {
+    Spinlock::Lock lock(m_mutex);
+    if(m_count > 0) {
+        --m_count;
+        return true;
+    }
+    return false;
+}
+
+void FiberSemaphore::notify(uint32_t n) {
+    FiberWaitQueue woken;
+    m_mutex.lock();
+    for(; n > 0; --n) {
+        FiberWaiter* w = m_waiters.pop();
+        if(!w) {
+            m_count += n;
+            break;
+        }
+        woken.push(w);
+    }
+    m_mutex.unlock();
+    while(FiberWaiter* w = woken.pop()) {
+        w->wake();
+    }
+}
+
+}
@@ -0,0 +1,83 @@
+#ifndef __SYLAR_FIBER_SYNC_H__
+#define __SYLAR_FIBER_SYNC_H__
+
+#include <stdint.h>
+#include "thread.h"
+#include "fiber.h"
+#include "noncopyable.h"
+
+//协程级别的同步原语，等待时只挂起当前协程，由Scheduler重新调度，不阻塞工作线程，
+//不在调度器的协程里调用时(普通线程)退化成用信号量阻塞线程，
+namespace sylar {
+
+class Scheduler;
+
+//一个等待者，放在等待协程(或线程)自己的栈上，串成侵入式的先进先出队列，
+struct FiberWaiter {
+    Scheduler* scheduler = nullptr;
+    Fiber::ptr fiber;
+    Semaphore* sem = nullptr;
+    FiberWaiter* next = nullptr;
+
+    //唤醒之后等待者所在的栈随时可能失效，调用后不能再访问this，
+    void wake();
+};
+
+class FiberWaitQueue {
+public:
+    bool empty() const { return m_head == nullptr;}
+    void push(FiberWaiter* w);
+    FiberWaiter* pop();
+
+    //lock必须已经加锁，把当前协程放进队列挂起，挂起之后才释放lock，被wake之后返回，返回时lock没有加锁，
+    void wait(Spinlock& lock);
+private:
+    FiberWaiter* m_head = nullptr;
+    FiberWaiter* m_tail = nullptr;
+};
+
+//协程互斥锁，解锁时直接把锁交给队首的等待者，先来先得，
+class FiberMutex : public Noncopyable {
+public:
+    typedef ScopedLockImpl<FiberMutex> Lock;
+
+    void lock();
+    bool trylock();
+    void unlock();
+private:
+    Spinlock m_mutex;
+    bool m_locked = false;
+    FiberWaitQueue m_waiters;
+};
+
+//协程条件变量，和FiberMutex一起用，
+class FiberCondVar : public Noncopyable {
+public:
+    //调用前mutex必须已经加锁，返回时重新加锁，
+    void wait(FiberMutex& mutex);
+    void notify_one();
+    void notify_all();
+private:
+    Spinlock m_mutex;
+    FiberWaitQueue m_waiters;
+};
+
+//协程信号量，notify时有等待者就直接交给它，没有才计数，
+class FiberSemaphore : public Noncopyable {
+public:
+    FiberSemaphore(uint32_t count = 0);
+
+    void wait();
+    bool tryWait();
+    void notify(uint32_t n = 1);
+
+    uint32_t getCount() const { return m_count;}
+private:
+    Spinlock m_mutex;
+    uint32_t m_count;
+    FiberWaitQueue m_waiters;
+};
+
+}
+
+#endif
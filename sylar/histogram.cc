@@ -0,0 +1,140 @@
+#include "histogram.h"
+#include <sstream>
+
+namespace sylar {
+
+Histogram::Histogram() {
+    reset();
+}
+
+int Histogram::BucketIndex(uint64_t value) {
+    if(value < (uint64_t)SUB_COUNT) {
+        return value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    if(msb >= MAX_BITS) {
+        return BUCKETS - 1;
+    }
+    int group = msb - SUB_BITS + 1;
+    int sub = (value >> (msb - SUB_BITS)) - SUB_COUNT;
+    return group * SUB_COUNT + sub;
+}
+
+uint64_t Histogram::BucketUpper(int idx) {
+    if(idx < SUB_COUNT) {
+        return idx;
+    }
+    int group = idx / SUB_COUNT;
+    int sub = idx % SUB_COUNT;
+    int shift = group - 1;
+    return (((uint64_t)(SUB_COUNT + sub + 1)) << shift) - 1;
+}
+
+void Histogram::record(uint64_t value) {
+    Add(m_buckets[BucketIndex(value)], 1);
+    Add(m_count, 1);
+    Add(m_sum, value);
+    if(value < m_min.load(std::memory_order_relaxed)) {
+        m_min.store(value, std::memory_order_relaxed);
+    }
+    if(value > m_max.load(std::memory_order_relaxed)) {
+        m_max.store(value, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::merge(const Histogram& other) {
+    for(int i = 0; i < BUCKETS; ++i) {
+        uint64_t n = other.m_buckets[i].load(std::memory_order_relaxed);
+        if(n) {
+            Add(m_buckets[i], n);
+        }
+    }
+    Add(m_count, other.count());
+    Add(m_sum, other.sum());
+    uint64_t v = other.m_min.load(std::memory_order_relaxed);
+    if(v < m_min.load(std::memory_order_relaxed)) {
+        m_min.store(v, std::memory_order_relaxed);
+    }
+    v = other.max();
+    if(v > max()) {
+        m_max.store(v, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::reset() {
+    for(int i = 0; i < BUCKETS; ++i) {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_min.store(~0ull, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::min() const {
+    uint64_t v = m_min.load(std::memory_order_relaxed);
+    return v == ~0ull ? 0 : v;
+}
+
+double Histogram::mean() const {
+    uint64_t n = count();
+    return n ? (double)sum() / n : 0;
+}
+
+uint64_t Histogram::percentile(double p) const {
+    //桶是分别读的，读的过程中可能还在record，用桶的总数而不是m_count，
+    uint64_t total = 0;
+    for(int i = 0; i < BUCKETS; ++i) {
+        total += m_buckets[i].load(std::memory_order_relaxed);
+    }
+    if(!total) {
+        return 0;
+    }
+    if(p < 0) {
+        p = 0;
+    } else if(p > 100) {
+        p = 100;
+    }
+    uint64_t rank = (uint64_t)(p / 100.0 * total + 0.5);
+    if(rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for(int i = 0; i < BUCKETS; ++i) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if(seen >= rank) {
+            uint64_t upper = BucketUpper(i);
+            uint64_t mx = max();
+            return upper > mx ? mx : upper;
+        }
+    }
+    return max();
+}
+
+std::ostream& Histogram::dump(std::ostream& os) const {
+    os << "count=" << count()
+       << " mean=" << (uint64_t)mean()
+       << " min=" << min()
+       << " p50=" << percentile(50)
+       << " p90=" << percentile(90)
+       << " p99=" << percentile(99)
+       << " p999=" << percentile(99.9)
+       << " max=" << max();
+    return os;
+}
+
+std::string Histogram::toJson() const {
+    std::stringstream ss;
+    ss << "{\"count\":" << count()
+       << ",\"mean\":" << (uint64_t)mean()
+       << ",\"min\":" << min()
+       << ",\"p50\":" << percentile(50)
+       << ",\"p90\":" << percentile(90)
+       << ",\"p99\":" << percentile(99)
+       << ",\"p999\":" << percentile(99.9)
+       << ",\"max\":" << max()
+       << "}";
+    return ss.str();
+}
+
+}
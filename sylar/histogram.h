@@ -0,0 +1,58 @@
+#ifndef __SYLAR_HISTOGRAM_H__
+#define __SYLAR_HISTOGRAM_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <ostream>
+#include <string>
+
+namespace sylar {
+
+//对数-线性分桶的直方图(类似HdrHistogram)，
+//小于SUB_COUNT的值每个值一个桶，之后每个2的幂区间再等分成SUB_COUNT个桶，相对误差不超过1/SUB_COUNT，
+//只允许一个线程record(每个工作线程一个)，其他线程可以随时读或者merge，
+class Histogram {
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int MAX_BITS = 48;    //大于等于2^48的值都算在最后一个桶里，
+    static const int BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT;
+
+    Histogram();
+
+    void record(uint64_t value);
+    //把other的数据累加进来，用于合并每个线程的直方图，
+    void merge(const Histogram& other);
+    void reset();
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed);}
+    uint64_t sum() const { return m_sum.load(std::memory_order_relaxed);}
+    uint64_t min() const;
+    uint64_t max() const { return m_max.load(std::memory_order_relaxed);}
+    double mean() const;
+    //p取值[0, 100]，返回对应分位所在桶的上界，
+    uint64_t percentile(double p) const;
+
+    //count=.. mean=.. p50=.. p90=.. p99=.. p999=.. max=..
+    std::ostream& dump(std::ostream& os) const;
+    std::string toJson() const;
+
+private:
+    static int BucketIndex(uint64_t value);
+    static uint64_t BucketUpper(int idx);
+
+    static void Add(std::atomic<uint64_t>& v, uint64_t n) {
+        v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> m_buckets[BUCKETS];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_min;
+    std::atomic<uint64_t> m_max;
+};
+
+}
+
+#endif
@@ -25,6 +25,7 @@ static sylar::ConfigVar<int>::ptr g_tcp_connect_timeout=
     XX(socket) \
     XX(connect) \
     XX(accept) \
+    XX(accept4) \
     XX(read) \
     XX(readv) \
     XX(recvfrom) \
@@ -130,7 +131,12 @@ retry:
         }
         
         int rt = iom->addEvent(fd, (sylar::IOManager::Event)(event));
-        if(rt) {
+        if(rt > 0) {    //持久注册的fd上次边缘触发后还没读写过，直接重试，
+            if(timer) {
+                timer->cancel();
+            }
+            goto retry;
+        } else if(rt) {
             SYLAR_LOG_ERROR(g_looger) << hook_fun_name << " addEvent("
                         <<fd << ", " <<event << ")";
             if(timer) {
@@ -155,6 +161,90 @@ retry:
 }
 
 
+//iomanager.backend为io_uring时，socket的读写、accept、connect直接交给io_uring，
+//不用先失败一次(EAGAIN)再注册epoll等待，返回false表示不能用io_uring，由调用者走原来的流程，
+//timeout_so为0时用timeout_ms作为超时，
+static bool uring_io(int fd, io_uring_sqe& sqe, int timeout_so, ssize_t& rt
+                    ,uint64_t timeout_ms = (uint64_t)-1) {
+    if(!sylar::t_hook_enable) {
+        return false;
+    }
+    sylar::IOManager* iom = sylar::IOManager::GetThis();
+    if(!iom || !iom->hasUring()) {
+        return false;
+    }
+    sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
+    if(!ctx || ctx->isClose() || !ctx->isSocket() || ctx->getUserNonblock()) {
+        return false;
+    }
+    sqe.fd = fd;
+    int res = 0;
+    uint64_t to = timeout_so ? ctx->getTimeout(timeout_so) : timeout_ms;
+    if(!iom->submitUring(sqe, to, res)) {
+        return false;
+    }
+    //老的内核对O_NONBLOCK的socket不会等待，提交队列满了也是-EAGAIN，交给epoll，
+    //被cancelAll取消的也走原来的流程，和epoll被cancelAll唤醒一样重试，fd已经关闭时得到EBADF，
+    if(res == -EAGAIN || res == -ECANCELED) {
+        return false;
+    }
+    if(res < 0) {
+        errno = -res;
+        rt = -1;
+    } else {
+        rt = res;
+    }
+    return true;
+}
+
+static bool uring_recv(int fd, void* buf, size_t len, int flags, ssize_t& rt) {
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_RECV;
+    sqe.addr = (uintptr_t)buf;
+    sqe.len = len;
+    sqe.msg_flags = flags;
+    return uring_io(fd, sqe, SO_RCVTIMEO, rt);
+}
+
+static bool uring_send(int fd, const void* buf, size_t len, int flags, ssize_t& rt) {
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_SEND;
+    sqe.addr = (uintptr_t)buf;
+    sqe.len = len;
+    sqe.msg_flags = flags;
+    return uring_io(fd, sqe, SO_SNDTIMEO, rt);
+}
+
+//accept4的等待部分，没有连接时挂起协程，不登记新fd，
+static int accept4_wait(int s, struct sockaddr *addr, socklen_t *addrlen, int flags) {
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_ACCEPT;
+    sqe.addr = (uintptr_t)addr;
+    sqe.addr2 = (uintptr_t)addrlen;
+    sqe.accept_flags = flags;
+    ssize_t rt = 0;
+    if(uring_io(s, sqe, SO_RCVTIMEO, rt)) {
+        return rt;
+    }
+    return do_io(s, accept4_f, "accept4", sylar::IOManager::READ
+        , SO_RCVTIMEO, addr, addrlen, flags);
+}
+
+namespace sylar {
+
+int accept_nonblock(int s, struct sockaddr *addr, socklen_t *addrlen) {
+    int fd = accept4_wait(s, addr, addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if(fd >= 0) {
+        FdMgr::GetInstance()->create(fd, true);
+    }
+    return fd;
+}
+
+}
+
 
 extern "C" {
 #define XX(name) name ## _fun name ## _f = nullptr;
@@ -221,7 +311,7 @@ int socket(int domain, int type, int protocol) {
     if(fd == -1) {
         return fd;
     }
-    sylar::FdMgr::GetInstance()->get(fd, true);    //当服务端的socket调用bind函数时，就将fd放到了fdmanager中了，
+    sylar::FdMgr::GetInstance()->create(fd);    //当服务端的socket调用bind函数时，就将fd放到了fdmanager中了，
     return fd;
 }
 
@@ -245,6 +335,16 @@ int connect_with_timeout(int fd, const struct sockaddr *addr,socklen_t addrlen,
     }
 
 
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_CONNECT;
+    sqe.addr = (uintptr_t)addr;
+    sqe.off = addrlen;
+    ssize_t urt = 0;
+    if(uring_io(fd, sqe, 0, urt, timeout_ms)) {
+        return urt;
+    }
+
     int n = connect_f(fd, addr, addrlen);
     if(n == 0) {
         return 0;
@@ -269,7 +369,11 @@ int connect_with_timeout(int fd, const struct sockaddr *addr,socklen_t addrlen,
     }
 
     int rt = iom->addEvent(fd, sylar::IOManager::WRITE);
-    if(rt == 0) {
+    if(rt > 0) {    //已经可写，连接已经完成，
+        if(timer) {
+            timer->cancel();
+        }
+    } else if(rt == 0) {
         sylar::Fiber::YieldToHold();
         if(timer) {
             timer->cancel();
@@ -304,10 +408,34 @@ int connect(int sockfd, const struct sockaddr *addr,socklen_t addrlen) {
 }
 
 int accept(int s, struct sockaddr *addr, socklen_t *addrlen) {
-    int fd = do_io(s, accept_f, "accept", sylar::IOManager::READ
-        , SO_RCVTIMEO, addr, addrlen);
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_ACCEPT;
+    sqe.addr = (uintptr_t)addr;
+    sqe.addr2 = (uintptr_t)addrlen;
+    ssize_t rt = 0;
+    int fd = 0;
+    if(uring_io(s, sqe, SO_RCVTIMEO, rt)) {
+        fd = rt;
+    } else {
+        fd = do_io(s, accept_f, "accept", sylar::IOManager::READ
+            , SO_RCVTIMEO, addr, addrlen);
+    }
+    if(fd >= 0) {
+        sylar::FdMgr::GetInstance()->create(fd);   //在这里就已经将客户端fd放到了fdmanager里面了，
+    }
+    return fd;
+}
+
+//和accept一样，带SOCK_NONBLOCK时新fd已经是非阻塞的socket，FdCtx不用再fstat和fcntl，
+//用户要的是非阻塞fd，所以同时标记为用户非阻塞，之后的读写没数据时直接返回EAGAIN，和fcntl设置的效果一样，
+int accept4(int s, struct sockaddr *addr, socklen_t *addrlen, int flags) {
+    int fd = accept4_wait(s, addr, addrlen, flags);
     if(fd >= 0) {
-        sylar::FdMgr::GetInstance()->get(fd, true);   //在这里就已经将客户端fd放到了fdmanager里面了，
+        sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->create(fd, flags & SOCK_NONBLOCK);
+        if(ctx && (flags & SOCK_NONBLOCK)) {
+            ctx->setUserNonblock(true);
+        }
     }
     return fd;
 }
@@ -315,6 +443,10 @@ int accept(int s, struct sockaddr *addr, socklen_t *addrlen) {
 
 
 ssize_t read(int fd, void *buf, size_t count) {
+    ssize_t rt = 0;
+    if(uring_recv(fd, buf, count, 0, rt)) {
+        return rt;
+    }
     return do_io(fd, read_f, "read", sylar::IOManager::READ, SO_RCVTIMEO, buf, count);
 }
 
@@ -324,6 +456,10 @@ ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
 }
 
 ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
+    ssize_t rt = 0;
+    if(uring_recv(sockfd, buf, len, flags, rt)) {
+        return rt;
+    }
     return do_io(sockfd, recv_f, "recv", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags);
 }
 
@@ -338,6 +474,10 @@ ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
 }
 
 ssize_t write(int fd, const void *buf, size_t count) {
+    ssize_t rt = 0;
+    if(uring_send(fd, buf, count, 0, rt)) {
+        return rt;
+    }
     return do_io(fd, write_f, "write", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, count);
 }
 
@@ -348,6 +488,10 @@ ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
 
 //这里和sylar的代码有点不一样，
 ssize_t send(int sockfd, const void *buf, size_t len, int flags) {
+    ssize_t rt = 0;
+    if(uring_send(sockfd, buf, len, flags, rt)) {
+        return rt;
+    }
     return do_io(sockfd, send_f, "send", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, len, flags);
 }
 
@@ -370,7 +514,7 @@ int close(int fd) {
     if(ctx) {
         auto iom = sylar::IOManager::GetThis();
         if(iom) {
-            iom->cancleAll(fd);
+            iom->cancelAll(fd);
         }
         sylar::FdMgr::GetInstance()->del(fd);
     }
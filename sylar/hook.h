@@ -12,6 +12,9 @@
 namespace sylar {
     bool is_hook_enable();
     void set_hook_enable(bool flag);
+    //框架内部用的accept4，没有连接时挂起协程，新fd是非阻塞socket但不标记为用户非阻塞，
+    //之后hook过的读写照样挂起协程等待，用户直接调accept4(SOCK_NONBLOCK)得到的fd是用户非阻塞的，
+    int accept_nonblock(int s, struct sockaddr *addr, socklen_t *addrlen);
 }
 
 extern "C" {
@@ -37,6 +40,9 @@ extern connect_fun connect_f;
 typedef int (*accept_fun)(int s, struct sockaddr *addr, socklen_t *addrlen);
 extern accept_fun accept_f;
 
+typedef int (*accept4_fun)(int s, struct sockaddr *addr, socklen_t *addrlen, int flags);
+extern accept4_fun accept4_f;
+
 extern int connect_with_timeout(int fd, const struct sockaddr *addr,socklen_t addrlen, uint64_t timeout_ms);
 
 
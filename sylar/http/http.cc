@@ -1,5 +1,6 @@
 #include "http.h"
 #include <string.h>
+#include <time.h>
 
 namespace sylar {
 namespace http {
@@ -65,6 +66,19 @@ HttpRequest::HttpRequest(uint8_t version, bool close)
 
 }
 
+void HttpRequest::reset() {
+    m_method = HttpMethod::GET;
+    m_version = 0x11;
+    m_close = true;
+    m_path.assign(1, '/');
+    m_query.clear();
+    m_fragment.clear();
+    m_body.clear();
+    m_headers.clear();
+    m_params.clear();
+    m_cookies.clear();
+}
+
 std::string HttpRequest::getHeader(const std::string& key
                     , const std::string& def = "") {
     auto it = m_headers.find(key);
@@ -205,6 +219,116 @@ void HttpResponse::delHeader(const std::string& key) {
     m_headers.erase(key);
 }
     
+static void AppendUint(std::string& out, uint64_t v) {
+    char buf[24];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    do {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while(v);
+    out.append(p, end - p);
+}
+
+namespace {
+//HTTP/1.1和HTTP/1.0下每个状态码的状态行，启动时生成好，
+struct _StatusLineIniter {
+    static const uint32_t MAX_CODE = 600;
+    std::string lines11[MAX_CODE];
+    std::string lines10[MAX_CODE];
+
+    _StatusLineIniter() {
+#define XX(code, name, msg) \
+        lines11[code] = "HTTP/1.1 " #code " " #msg "\r\n"; \
+        lines10[code] = "HTTP/1.0 " #code " " #msg "\r\n";
+        HTTP_STATUS_MAP(XX);
+#undef XX
+    }
+
+    //没有预先生成的返回nullptr
+    const std::string* get(uint8_t version, uint32_t code) const {
+        if(code >= MAX_CODE) {
+            return nullptr;
+        }
+        const std::string* line = nullptr;
+        if(version == 0x11) {
+            line = &lines11[code];
+        } else if(version == 0x10) {
+            line = &lines10[code];
+        }
+        return (line && !line->empty()) ? line : nullptr;
+    }
+};
+
+static _StatusLineIniter s_status_lines;
+
+//每个线程缓存当前这一秒的Date头，秒数变了才重新格式化，
+static thread_local time_t t_date_sec = -1;
+static thread_local char t_date_line[64];
+static thread_local size_t t_date_len = 0;
+
+static void AppendDate(std::string& out) {
+    time_t now = time(nullptr);
+    if(now != t_date_sec) {
+        struct tm tm;
+        gmtime_r(&now, &tm);
+        t_date_len = strftime(t_date_line, sizeof(t_date_line)
+                        , "date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+        t_date_sec = now;
+    }
+    out.append(t_date_line, t_date_len);
+}
+}
+
+void HttpResponse::serializeHeader(std::string& out) const {
+    const std::string* line = m_reason.empty()
+                ? s_status_lines.get(m_version, (uint32_t)m_status) : nullptr;
+    if(line) {
+        out.append(*line);
+    } else {
+        out.append("HTTP/", 5);
+        out.push_back('0' + (m_version >> 4));
+        out.push_back('.');
+        out.push_back('0' + (m_version & 0x0F));
+        out.push_back(' ');
+        AppendUint(out, (uint32_t)m_status);
+        out.push_back(' ');
+        if(m_reason.empty()) {
+            out.append(HttpStatusToString(m_status));
+        } else {
+            out.append(m_reason);
+        }
+        out.append("\r\n", 2);
+    }
+
+    bool has_date = false;
+    for(auto& i : m_headers) {
+        if(strcasecmp(i.first.c_str(), "connection") == 0
+                || strcasecmp(i.first.c_str(), "content-length") == 0) {
+            continue;
+        }
+        if(!has_date && strcasecmp(i.first.c_str(), "date") == 0) {
+            has_date = true;
+        }
+        out.append(i.first);
+        out.push_back(':');
+        out.append(i.second);
+        out.append("\r\n", 2);
+    }
+    if(!has_date) {
+        AppendDate(out);
+    }
+    if(m_close) {
+        out.append("connection: close\r\n");
+    } else {
+        out.append("connection: keep-alive\r\n");
+    }
+    //body为空也要带上长度，否则keep-alive的客户端不知道响应在哪结束，
+    out.append("content-length: ");
+    AppendUint(out, m_body.size());
+    out.append("\r\n\r\n", 4);
+}
+
 std::string HttpResponse::toString() const {
     std::stringstream ss;
     dump(ss);
@@ -197,6 +197,7 @@ public:
     void setQuery(const std::string& v) { m_query = v;}
     void setFragment(const std::string& v) { m_fragment = v;}
     void setBody(const std::string& v) { m_body = v;}
+    void setBody(std::string&& v) { m_body = std::move(v);}
 
     void setHeaders(MapType v) { m_headers = v;}
     void setParams(MapType& v) { m_params = v;}
@@ -252,6 +253,9 @@ public:
 
     bool isClose() { return m_close;}
 
+    //恢复成刚构造时的状态，字符串只清空不释放，keep-alive连接上复用同一个对象，
+    void reset();
+
     std::string toString() const;
     std::ostream& dump(std::ostream& os) const;
 
@@ -314,6 +318,9 @@ public:
 
     std::string toString() const;
     std::ostream& dump(std::ostream& os) const;
+    //把状态行和所有头部(包括空行，不包括body)追加到out，不经过stream，
+    //发送时body直接用getBody()的存储，不用拷贝，
+    void serializeHeader(std::string& out) const;
 private:
     HttpStatus m_status;
     uint8_t m_version;
@@ -6,6 +6,7 @@
 #include "socket_stream.h"
 #include "uri.h"
 #include "sylar/thread.h"
+#include "sylar/fiber_sync.h"
 #include <list>
 #include <atomic>
 
@@ -108,7 +109,8 @@ private:
 class HttpConnectionPool {
 public:
     typedef std::shared_ptr<HttpConnectionPool> ptr;
-    typedef Mutex MutexType;
+    //取连接的协程只在这把锁上挂起自己，不阻塞工作线程，
+    typedef FiberMutex MutexType;
 
     HttpConnectionPool(const std::string& host
                         ,const std::string& vhost
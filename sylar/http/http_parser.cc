@@ -180,6 +180,16 @@ HttpRequestParser::HttpRequestParser()
     m_parser.data = this;
 }
 
+void HttpRequestParser::reset() {
+    if(m_data.unique()) {
+        m_data->reset();
+    } else {
+        m_data.reset(new sylar::http::HttpRequest());
+    }
+    http_parser_init(&m_parser);    //只重置状态机，回调不变，
+    m_error = 0;
+}
+
 //1:成功
 //-1：失败
 //>0 已经处理的字节数，且data有效数据为len - offset
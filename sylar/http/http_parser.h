@@ -13,6 +13,8 @@ class HttpRequestParser {
 public:
     typedef std::shared_ptr<HttpRequestParser> ptr;
     HttpRequestParser();
+    //准备解析下一个请求，上一个请求对象没有被别人持有时直接复用，否则新建一个，
+    void reset();
     size_t execute(char* data, size_t len);
     int isFinished();
     int hasError();
@@ -17,6 +17,7 @@ HttpServer::HttpServer(bool keepalive
     
 void HttpServer::handleClient(Socket::ptr client) {
     HttpSession::ptr session(new HttpSession(client));   //如果server连接到了一个浏览器请求， 就要为这个连接创建一个httpSession，
+    std::vector<HttpResponse::ptr> rsps;
     do {
         auto req = session->recvRequest();
         if(!req) {
@@ -25,14 +26,28 @@ void HttpServer::handleClient(Socket::ptr client) {
                 << "client:" << *client;
             break;
         }
-        HttpResponse::ptr rsp(new HttpResponse(req->getVersion()
-                    , req->isClose() || !m_isKeepalive));
-        m_dispatch->handle(req, rsp, session);
-        session->sendResponse(rsp);   //在这里，当m_dispatch->handle函数处理完成后，就通过sendResponse函数将response写会给浏览器，
+        //客户端流水线发来的请求可能已经在缓冲区里了，全部按顺序处理完，响应一次发出去，
+        bool close = false;
+        rsps.clear();
+        while(req) {
+            HttpResponse::ptr rsp(new HttpResponse(req->getVersion()
+                        , req->isClose() || !m_isKeepalive));
+            m_dispatch->handle(req, rsp, session);
+            rsps.push_back(rsp);
+            if(rsp->isClose()) {
+                close = true;
+                break;
+            }
+            req.reset();        //不再持有，解析器可以复用这个请求对象，
+            req = session->tryRecvRequest();
+        }
+        if(session->sendResponses(rsps) <= 0 || close) {   //在这里，当m_dispatch->handle函数处理完成后，就通过sendResponses函数将response写会给浏览器，
+            break;
+        }
     } while(true);
     session->close();
 }
 
 }
 
-}
\ No newline at end of file
+}
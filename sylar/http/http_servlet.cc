@@ -1,4 +1,5 @@
 #include "http_servlet.h"
+#include "servlet_router.h"
 #include <fnmatch.h>
 
 namespace sylar {
@@ -31,35 +32,99 @@ int32_t FunctionServlet::handle(sylar::http::HttpRequest::ptr request
     return m_cb(request, response, session);
 }
 
+//所有ServletDispatch共用一个递增的版本号，线程缓存只要版本号相同就一定是同一个快照，
+static std::atomic<uint64_t> s_router_version = {0};
+
+namespace {
+struct RouterCache {
+    uint64_t version = 0;
+    std::shared_ptr<ServletRouter> router;
+};
+}
+
+static thread_local RouterCache t_router_cache;
+
 ServletDispatch::ServletDispatch() 
-    :Servlet("ServletDispatch"){
+    :Servlet("ServletDispatch")
+    ,m_version(0){
     m_default.reset(new NotFoundServlet());
+    MutexType::Lock lock(m_mutex);
+    rebuild();
 }
 
 
 int32_t ServletDispatch::handle(sylar::http::HttpRequest::ptr request
                             , sylar::http::HttpResponse::ptr response
                             , sylar::http::HttpSession::ptr session) {
-    auto slt = getMatchedServelt(request->getPath());
+    ServletRouter::Params params;
+    auto slt = getMatchedServelt(request->getPath(), &params);
+    for(auto& i : params) {
+        request->setParam(i.first, i.second);
+    }
     if(slt) {
         slt->handle(request, response, session);
     }
     return 0;
 }
 
+void ServletDispatch::rebuild() {
+    ServletRouter::ptr router(new ServletRouter);
+    for(auto& i : m_datas) {
+        router->addExact(i.first, i.second);
+    }
+    //前缀路由在所有glob之前匹配，所以只有排在第一个普通glob前面的前缀glob能放进基数树，
+    //后面的还是按加入顺序用fnmatch，否则会抢走先加入的普通glob的请求，
+    //基数树里的前缀路由之间也按加入顺序，结果和原来逐个fnmatch一样，
+    bool prefix_ok = true;
+    for(auto& i : m_globs) {
+        if(prefix_ok && ServletRouter::IsPrefixGlob(i.first)) {
+            router->addPrefix(i.first.substr(0, i.first.size() - 1), i.second);
+        } else {
+            prefix_ok = false;
+            router->addGlob(i.first, i.second);
+        }
+    }
+    router->setDefault(m_default);
+    //先发布快照再发布版本号，读到新版本号的线程一定能取到新快照，
+    std::atomic_store(&m_router, router);
+    m_version.store(++s_router_version, std::memory_order_release);
+}
+
+//返回的指针由线程缓存持有，只能在当前协程让出之前使用，
+ServletRouter* ServletDispatch::getRouter() {
+    uint64_t version = m_version.load(std::memory_order_acquire);
+    RouterCache& cache = t_router_cache;
+    if(cache.version != version) {
+        cache.router = std::atomic_load(&m_router);
+        cache.version = version;
+    }
+    return cache.router.get();
+}
+
 void ServletDispatch::addServelt(const std::string& uri
                     , Servlet::ptr slt) {
-    RWMutexType::WriteLock lock(m_mutex);
+    MutexType::Lock lock(m_mutex);
+    //只有参数名不同的路由在路由表里是同一条，先删掉旧的，否则rebuild按哈希顺序决定用哪个，
+    if(uri.find(':') != std::string::npos) {
+        std::string shape = ServletRouter::Shape(uri);
+        for(auto it = m_datas.begin(); it != m_datas.end();) {
+            if(it->first != uri && ServletRouter::Shape(it->first) == shape) {
+                it = m_datas.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
     m_datas[uri] = slt;
+    rebuild();
 }
 void ServletDispatch::addServelt(const std::string& uri
                     , FunctionServlet::callback cb) {
-    RWMutexType::WriteLock lock(m_mutex);
-    m_datas[uri].reset(new FunctionServlet(cb));
+    return addServelt(uri, FunctionServlet::ptr(new FunctionServlet(cb)));
 }
 void ServletDispatch::addGlobServlet(const std::string& uri
                     , Servlet::ptr slt) {
-    RWMutexType::WriteLock lock(m_mutex);
+    MutexType::Lock lock(m_mutex);
     for(auto it = m_globs.begin();
             it != m_globs.end(); ++it) {
         if(it->first == uri) {
@@ -68,6 +133,7 @@ void ServletDispatch::addGlobServlet(const std::string& uri
         }
     }
     m_globs.push_back(std::make_pair(uri, slt));
+    rebuild();
 }
 void ServletDispatch::addGlobServlet(const std::string& uri
                     , FunctionServlet::callback cb) {
@@ -75,12 +141,13 @@ void ServletDispatch::addGlobServlet(const std::string& uri
 }
 
 void ServletDispatch::delServlet(const std::string& uri) {
-    RWMutexTypeType::WriteLock lock(m_mutex);
+    MutexType::Lock lock(m_mutex);
     m_datas.erase(uri);
+    rebuild();
 }
 
 void ServletDispatch::delGlobServlet(const std::string& uri) {
-    RWMutexType::WriteLock lock(m_mutex);
+    MutexType::Lock lock(m_mutex);
     for(auto it = m_globs.begin();
             it != m_globs.end(); ++it) {
         if(it->first == uri) {
@@ -88,16 +155,28 @@ void ServletDispatch::delGlobServlet(const std::string& uri) {
             break;
         }
     }
+    rebuild();
 }   
 
+Servlet::ptr ServletDispatch::getDefault() {
+    MutexType::Lock lock(m_mutex);
+    return m_default;
+}
+
+void ServletDispatch::setDefault(Servlet::ptr v) {
+    MutexType::Lock lock(m_mutex);
+    m_default = v;
+    rebuild();
+}
+
 Servlet::ptr ServletDispatch::getServlet(const std::string& uri) {
-    RWMutexType::WriteLock lock(m_mutex);
+    MutexType::Lock lock(m_mutex);
     auto it = m_datas.find(uri);
     return it == m_datas.end() ? nullptr : it->second;
 }
 
 Servlet::ptr ServletDispatch::getGlobServlet(const std::string& uri) {
-    RWMutexType::WriteLock lock(m_mutex);
+    MutexType::Lock lock(m_mutex);
     for(auto it = m_globs.begin();
             it != m_globs.end(); ++it) {
         if(!fnmatch(it->first.c_str(), uri.c_str(), 0)) {
@@ -107,24 +186,14 @@ Servlet::ptr ServletDispatch::getGlobServlet(const std::string& uri) {
     return nullptr;
 }
 
-
-
-
-
 Servlet::ptr ServletDispatch::getMatchedServelt(const std::string& uri) {
-    RWMutexType::WriteLock lock(m_mutex);
-    auto mit = m_datas.find(uri);
-    if(mit != m_datas.end()) {
-        return mit->second;
-    }
-    for(auto it = m_globs.begin();
-            it != m_globs.end(); ++it) {
-        if(!fnmatch(it->first ,uri.c_str(), 0)) {
-            return it->second;
-        }
-    }
-    return m_default;
+    return getRouter()->match(uri);
+}
+
+Servlet::ptr ServletDispatch::getMatchedServelt(const std::string& uri
+                    , std::vector<std::pair<std::string, std::string> >* params) {
+    return getRouter()->match(uri, params);
 }
 
 }   
-}
\ No newline at end of file
+}
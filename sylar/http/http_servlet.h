@@ -8,6 +8,7 @@
 #include "http_session.h"
 #include <unordered_map>
 #include <vector>
+#include <atomic>
 #include "sylar/thread.h"
 
 namespace sylar {
@@ -58,10 +59,14 @@ private:
 };
 
 
+class ServletRouter;
+
+//注册的路由编译成一个只读的ServletRouter快照，修改时重新编译再整体替换，
+//请求查找时不加锁: 每个线程缓存最近用过的快照，只比较一个版本号，
 class ServletDispatch : public Servlet {
 public:
     typedef std::shared_ptr<ServletDispatch> ptr;
-    typedef RWMutex RWMutexType;
+    typedef Mutex MutexType;
 
     ServletDispatch();
 
@@ -81,20 +86,32 @@ public:
     void delServlet(const std::string& uri);
     void delGlobServlet(const std::string& uri);
 
-    Servlet::ptr getDefault() const { return m_default;}
-    void setDefault(Servlet::ptr v) { m_default = v;}
+    Servlet::ptr getDefault();
+    void setDefault(Servlet::ptr v);
 
     Servlet::ptr getMatchedServelt(const std::string& uri);
+    //匹配到的:param参数追加到params，
+    Servlet::ptr getMatchedServelt(const std::string& uri
+                        , std::vector<std::pair<std::string, std::string> >* params);
+
+private:
+    //m_mutex加锁后调用，重新编译路由并发布，
+    void rebuild();
+    ServletRouter* getRouter();
 
 private:
-    
-    RWMutexType m_mutex;
-    //uri(sylar/xxx) ->servlet     精准查询
+    //只有修改路由的时候用，
+    MutexType m_mutex;
+    //uri(sylar/xxx) ->servlet     精准查询，可以带:param段
     std::unordered_map<std::string, Servlet::ptr> m_datas;
     //uri(sylar/*) -> servlet 模糊查询
     std::vector<std::pair<std::string, Servlet::ptr> > m_globs;
     //默认servlet， 没有匹配到任何路径时使用，
     Servlet::ptr m_default;
+    //当前发布的路由，用std::atomic_load/atomic_store读写，
+    std::shared_ptr<ServletRouter> m_router;
+    //m_router的版本，全局唯一，
+    std::atomic<uint64_t> m_version;
 
 };
 
@@ -12,72 +12,145 @@ HttpSession::HttpSession(Socket::ptr sock, bool owner)
 
 
 HttpRequest::ptr HttpSession::recvRequest() {
-    HttpRequestParser::ptr parser(new HttpRequestParser());
-    uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();
-    std::shared_ptr<char> buffer(
-            new char[buff_size], [](char* ptr) {
-                delete[] ptr;
-    });
-    char* data = buffer.get();
-    int offset = 0;
+    if(m_error) {
+        close();
+        return nullptr;
+    }
+    return doRecvRequest(true);
+}
+
+HttpRequest::ptr HttpSession::tryRecvRequest() {
+    if(m_error || m_offset == 0) {
+        return nullptr;
+    }
+    return doRecvRequest(false);
+}
+
+HttpRequest::ptr HttpSession::doRecvRequest(bool block) {
+    if(!m_buffer) {
+        m_bufferSize = HttpRequestParser::GetHttpRequestBufferSize();
+        m_buffer.reset(new char[m_bufferSize]);
+    }
+    if(!m_parsing) {
+        m_parser.reset();
+        m_parsing = true;
+    }
+    char* data = m_buffer.get();
+    size_t len = m_offset;      //上一个请求之后留下的数据先解析，
 
     do{
-        int len = read(data + offset, buff_size - offset);
-        if(len <= 0) {
-            close();
-            return nullptr;
+        if(len > 0) {
+            size_t nparse = m_parser.execute(data, len);
+            if(m_parser.hasError()) {
+                return onRecvError(block);
+            }
+            len -= nparse;   //处理了nparse个，就减去已经处理了的，
+            if(m_parser.isFinished()) {
+                break;
+            }
         }
-        len += offset;
-        size_t nparse = parser->execute(data, len);
-        if(parser->hasError()) {
-            close();
+        if(len == m_bufferSize) {
+            return onRecvError(block);
+        }
+        if(!block) {    //请求头还不完整，留着下次接着解析，
+            m_offset = len;
             return nullptr;
         }
-        offset = len - nparse;   //处理了nparse个，就减去已经处理了的，
-        if(offset == (int)buff_size) {
+        int rt = read(data + len, m_bufferSize - len);
+        if(rt <= 0) {
             close();
             return nullptr;
         }
-        if(parser->isFinished()) {
-            break;
-        } 
+        len += rt;
     } while(true);
-    
-    int64_t length = parser->getContentLength();
+    m_parsing = false;
+
+    HttpRequest::ptr req = m_parser.getData();
+    uint64_t length = m_parser.getContentLength();
+    if(length > HttpRequestParser::GetHttpRequestMaxBodySize()) {
+        return onRecvError(block);
+    }
+    size_t used = 0;
     if(length > 0) {
         std::string body;
         body.resize(length);
-
-        int len = 0;
-        if(length >= offset) {
-            memcpy(&body[0], data, offset);
-            len = offset;
-        } else {
-            memcpy(&body[0], data, length);
-            len = length;
-        }
-        length -= offset;
-        if(length > 0) {
-            if(readFixSize(&body[len], length) <= 0) {
+        used = length < len ? length : len;
+        memcpy(&body[0], data, used);
+        if(length > used) {
+            if(readFixSize(&body[used], length - used) <= 0) {
                 close();
                 return nullptr;
             }
         }
-        parser->getData()->setBody(body);
+        req->setBody(std::move(body));
     }
-    return parser->getData();
+    m_offset = len - used;      //属于下一个请求的数据挪到开头，
+    if(m_offset && used) {
+        memmove(data, data + used, m_offset);
+    }
+    return req;
 }
 
 
-int HttpSession::sendResponse(HttpResponse::ptr rsp) {
-    std::stringstream ss;
-    ss <<*rsp;    
-    std::string data = ss.str();
-    return writeFixSize(data.c_str(), data.size());
+HttpRequest::ptr HttpSession::onRecvError(bool block) {
+    m_parsing = false;
+    m_offset = 0;
+    if(block) {
+        close();
+    } else {    //前面的请求的响应还没发，先不关，
+        m_error = true;
+    }
+    return nullptr;
+}
+
+//响应头追加到m_writeBuffer，对应的iovec先只记长度(iov_base为空)，
+//m_writeBuffer追加时可能重新分配，等全部追加完了再在flushResponses里填地址，
+void HttpSession::appendResponse(HttpResponse::ptr rsp) {
+    size_t old = m_writeBuffer.size();
+    rsp->serializeHeader(m_writeBuffer);
+    iovec iov;
+    iov.iov_base = nullptr;
+    iov.iov_len = m_writeBuffer.size() - old;
+    m_iovs.push_back(iov);
+
+    const std::string& body = rsp->getBody();
+    if(!body.empty()) {
+        iov.iov_base = (void*)body.data();
+        iov.iov_len = body.size();
+        m_iovs.push_back(iov);
+    }
+}
+
+int HttpSession::flushResponses() {
+    char* base = &m_writeBuffer[0];
+    for(auto& i : m_iovs) {
+        if(!i.iov_base) {
+            i.iov_base = base;
+            base += i.iov_len;
+        }
+    }
+    int rt = writevFixSize(&m_iovs[0], m_iovs.size());
+    m_iovs.clear();
+    m_writeBuffer.clear();
+    return rt;
+}
 
+int HttpSession::sendResponses(const std::vector<HttpResponse::ptr>& rsps) {
+    if(rsps.empty()) {
+        return 0;
+    }
+    for(auto& rsp : rsps) {
+        appendResponse(rsp);
+    }
+    return flushResponses();
+}
+
+int HttpSession::sendResponse(HttpResponse::ptr rsp) {
+    appendResponse(rsp);
+    return flushResponses();
 }
 
 }
 
 
-}
\ No newline at end of file
+}
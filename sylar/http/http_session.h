@@ -3,6 +3,7 @@
 
 #include <memory>
 #include "http.h"
+#include "http_parser.h"
 #include "sylar/streams/socket_stream.h"
 
 namespace sylar {
@@ -13,9 +14,32 @@ public:
 
     HttpSession(Socket::ptr sock, bool owner = true);
 
+    //读缓冲和解析器在整个连接上复用，一个请求之后多读到的数据留到下一次，
     HttpRequest::ptr recvRequest();
+    //只解析缓冲区里已经收到的数据，请求头不完整时返回nullptr，不等socket，
+    //(请求头完整但请求体没收完时会把请求体读完)，用来取出客户端流水线(pipelining)发过来的后续请求，
+    HttpRequest::ptr tryRecvRequest();
 
     int sendResponse(HttpResponse::ptr rsp);
+    //按顺序把多个响应用一次writev发出去，
+    int sendResponses(const std::vector<HttpResponse::ptr>& rsps);
+
+private:
+    HttpRequest::ptr doRecvRequest(bool block);
+    HttpRequest::ptr onRecvError(bool block);
+    void appendResponse(HttpResponse::ptr rsp);
+    int flushResponses();
+
+private:
+    HttpRequestParser m_parser;
+    std::unique_ptr<char[]> m_buffer;
+    size_t m_bufferSize = 0;
+    size_t m_offset = 0;        //缓冲区开头还没解析的字节数
+    bool m_parsing = false;     //tryRecvRequest解析了一半的请求，下次接着解析，不reset
+    bool m_error = false;       //tryRecvRequest解析出错，下次recvRequest时关闭
+    //发送时复用，响应头写进m_writeBuffer，和各个body一起组成m_iovs，
+    std::string m_writeBuffer;
+    std::vector<iovec> m_iovs;
 
 };
 
@@ -0,0 +1,207 @@
+#include "servlet_router.h"
+#include <string.h>
+#include <fnmatch.h>
+
+namespace sylar {
+namespace http {
+
+struct ServletRouter::Node {
+    std::string label;          //压缩后的边，静态字节
+    std::string indices;        //每个静态子节点label的第一个字节，和children一一对应
+    std::vector<std::unique_ptr<Node> > children;
+    std::unique_ptr<Node> param;    //":name"段，label为空，匹配到下一个'/'为止
+    Servlet::ptr exact;         //路径正好在这里结束
+    //exact路由的参数名，按出现顺序，不同路由可以在同一个param节点上用不同的名字，
+    std::vector<std::string> names;
+    Servlet::ptr prefix;        //路径以这里为前缀
+    size_t prefixOrder = 0;     //prefix的加入顺序，越小越优先
+};
+
+struct ServletRouter::MatchContext {
+    const char* begin;
+    const char* end;
+    const Servlet::ptr* exact = nullptr;
+    const std::vector<std::string>* names = nullptr;
+    const Servlet::ptr* prefix = nullptr;
+    size_t prefixOrder = 0;
+    Params* params = nullptr;
+    //匹配过程中经过的参数段[first, second)，匹配到exact之后再和叶子上的参数名对应起来，
+    std::vector<std::pair<const char*, const char*> > values;
+};
+
+ServletRouter::ServletRouter()
+    :m_root(new Node) {
+}
+
+ServletRouter::~ServletRouter() {
+}
+
+bool ServletRouter::IsPrefixGlob(const std::string& pattern) {
+    if(pattern.empty() || pattern[pattern.size() - 1] != '*') {
+        return false;
+    }
+    return pattern.find_first_of("*?[\\") == pattern.size() - 1;
+}
+
+void ServletRouter::addExact(const std::string& uri, Servlet::ptr slt) {
+    std::vector<std::string> names;
+    Node* node = insert(uri, &names);
+    node->exact = slt;
+    node->names.swap(names);
+}
+
+void ServletRouter::addPrefix(const std::string& prefix, Servlet::ptr slt) {
+    Node* node = insert(prefix, nullptr);
+    if(!node->prefix) {
+        node->prefix = slt;
+        node->prefixOrder = m_prefixCount++;
+    }
+}
+
+void ServletRouter::addGlob(const std::string& pattern, Servlet::ptr slt) {
+    m_globs.push_back(std::make_pair(pattern, slt));
+}
+
+std::string ServletRouter::Shape(const std::string& uri) {
+    std::string rt;
+    size_t i = 0;
+    while(i < uri.size()) {
+        if(uri[i] == ':' && (i == 0 || uri[i - 1] == '/')) {
+            rt.push_back(':');
+            i = uri.find('/', i);
+            if(i == std::string::npos) {
+                break;
+            }
+        }
+        rt.push_back(uri[i++]);
+    }
+    return rt;
+}
+
+ServletRouter::Node* ServletRouter::insert(const std::string& uri, std::vector<std::string>* names) {
+    Node* node = m_root.get();
+    size_t i = 0;
+    while(i < uri.size()) {
+        size_t pos = i;
+        while(pos < uri.size()) {   //找下一个参数段，
+            if(names && uri[pos] == ':' && (pos == 0 || uri[pos - 1] == '/')) {
+                break;
+            }
+            ++pos;
+        }
+        node = insertStatic(node, uri.data() + i, pos - i);
+        if(pos == uri.size()) {
+            break;
+        }
+        size_t end = uri.find('/', pos);
+        if(end == std::string::npos) {
+            end = uri.size();
+        }
+        if(!node->param) {
+            node->param.reset(new Node);
+        }
+        names->push_back(uri.substr(pos + 1, end - pos - 1));
+        node = node->param.get();
+        i = end;
+    }
+    return node;
+}
+
+ServletRouter::Node* ServletRouter::insertStatic(Node* node, const char* str, size_t len) {
+    while(len > 0) {
+        size_t idx = node->indices.find(str[0]);
+        if(idx == std::string::npos) {
+            Node* child = new Node;
+            child->label.assign(str, len);
+            node->indices.push_back(str[0]);
+            node->children.emplace_back(child);
+            return child;
+        }
+        Node* child = node->children[idx].get();
+        size_t l = 0;
+        while(l < child->label.size() && l < len && child->label[l] == str[l]) {
+            ++l;
+        }
+        if(l < child->label.size()) {   //只有一部分相同，把这条边从l处拆开，
+            Node* mid = new Node;
+            mid->label = child->label.substr(0, l);
+            child->label.erase(0, l);
+            mid->indices.push_back(child->label[0]);
+            mid->children.emplace_back(std::move(node->children[idx]));
+            node->children[idx].reset(mid);
+            child = mid;
+        }
+        node = child;
+        str += l;
+        len -= l;
+    }
+    return node;
+}
+
+bool ServletRouter::matchNode(const Node* node, const char* p, MatchContext& ctx) const {
+    size_t llen = node->label.size();
+    if((size_t)(ctx.end - p) < llen || memcmp(p, node->label.data(), llen) != 0) {
+        return false;
+    }
+    p += llen;
+    //路径上的前缀路由都匹配，取先加入的，不是最长的，
+    if(node->prefix && (!ctx.prefix || node->prefixOrder < ctx.prefixOrder)) {
+        ctx.prefix = &node->prefix;    //前缀路由不带参数段，
+        ctx.prefixOrder = node->prefixOrder;
+    }
+    if(p == ctx.end) {
+        if(node->exact) {
+            ctx.exact = &node->exact;
+            ctx.names = &node->names;
+            return true;
+        }
+        return false;
+    }
+    //静态段优先，不匹配再回退到参数段，
+    const char* idx = (const char*)memchr(node->indices.data(), *p, node->indices.size());
+    if(idx && matchNode(node->children[idx - node->indices.data()].get(), p, ctx)) {
+        return true;
+    }
+    if(node->param) {
+        const char* q = (const char*)memchr(p, '/', ctx.end - p);
+        if(!q) {
+            q = ctx.end;
+        }
+        if(q > p) {
+            ctx.values.push_back(std::make_pair(p, q));
+            if(matchNode(node->param.get(), q, ctx)) {
+                return true;
+            }
+            ctx.values.pop_back();
+        }
+    }
+    return false;
+}
+
+Servlet::ptr ServletRouter::match(const std::string& path, Params* params) const {
+    MatchContext ctx;
+    ctx.begin = path.data();
+    ctx.end = path.data() + path.size();
+    ctx.params = params;
+    if(matchNode(m_root.get(), ctx.begin, ctx)) {
+        if(params) {
+            for(size_t i = 0; i < ctx.values.size(); ++i) {
+                params->push_back(std::make_pair((*ctx.names)[i]
+                        , std::string(ctx.values[i].first, ctx.values[i].second)));
+            }
+        }
+        return *ctx.exact;
+    }
+    if(ctx.prefix) {
+        return *ctx.prefix;
+    }
+    for(auto& i : m_globs) {
+        if(!fnmatch(i.first.c_str(), path.c_str(), 0)) {
+            return i.second;
+        }
+    }
+    return m_default;
+}
+
+}
+}
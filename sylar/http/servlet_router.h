@@ -0,0 +1,60 @@
+#ifndef __SYLAR_HTTP_SERVLET_ROUTER_H__
+#define __SYLAR_HTTP_SERVLET_ROUTER_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "http_servlet.h"
+
+namespace sylar {
+namespace http {
+
+//编译好的路由表(基数树)，构建完之后只读，多个线程同时match不需要加锁，
+//匹配优先级: 精确路由(静态段优先于:param段) > 前缀路由(按加入顺序) > 其他glob(按加入顺序用fnmatch) > 默认servlet
+class ServletRouter {
+public:
+    typedef std::shared_ptr<ServletRouter> ptr;
+    typedef std::vector<std::pair<std::string, std::string> > Params;
+
+    ServletRouter();
+    ~ServletRouter();
+
+    //uri里以':'开头的段是参数，比如/user/:id/profile，参数名跟着各自的路由，
+    //形状相同(只有参数名不同)的路由会互相覆盖，以后加入的为准，
+    void addExact(const std::string& uri, Servlet::ptr slt);
+    //以prefix开头的路径都交给slt，多个前缀都匹配时取先加入的，和按顺序fnmatch一样，
+    //同一个prefix重复加入时保留先加入的，
+    void addPrefix(const std::string& prefix, Servlet::ptr slt);
+    //任意fnmatch模式，
+    void addGlob(const std::string& pattern, Servlet::ptr slt);
+    void setDefault(Servlet::ptr v) { m_default = v;}
+
+    //params不为空时把匹配到的参数追加进去，没有匹配的路由返回默认servlet，
+    Servlet::ptr match(const std::string& path, Params* params = nullptr) const;
+
+    //"xxx*"并且前面没有其他通配符的glob可以当作前缀路由，
+    //前缀路由总是在其他glob之前匹配，调用者要保证它们加入时前面没有普通glob，
+    static bool IsPrefixGlob(const std::string& pattern);
+    //去掉参数名之后的路由形状，/user/:id和/user/:uid都是/user/:，形状相同的路由在基数树里是同一个叶子，
+    static std::string Shape(const std::string& uri);
+
+private:
+    struct Node;
+    struct MatchContext;
+
+    //names不为空时解析':'参数段，并把参数名按顺序追加进去，
+    Node* insert(const std::string& uri, std::vector<std::string>* names);
+    Node* insertStatic(Node* node, const char* str, size_t len);
+    bool matchNode(const Node* node, const char* p, MatchContext& ctx) const;
+
+private:
+    std::unique_ptr<Node> m_root;
+    size_t m_prefixCount = 0;       //已经加入的前缀路由个数，用作加入顺序，
+    std::vector<std::pair<std::string, Servlet::ptr> > m_globs;
+    Servlet::ptr m_default;
+};
+
+}
+}
+
+#endif
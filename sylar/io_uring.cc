@@ -0,0 +1,166 @@
+#include "io_uring.h"
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+namespace sylar {
+
+static int io_uring_setup(unsigned entries, io_uring_params* p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+IoUring::IoUring() {
+}
+
+IoUring::~IoUring() {
+    destroy();
+}
+
+void IoUring::destroy() {
+    if(m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+        m_sqes = nullptr;
+    }
+    if(m_cqRing && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    m_cqRing = nullptr;
+    if(m_sqRing) {
+        munmap(m_sqRing, m_sqRingSize);
+        m_sqRing = nullptr;
+    }
+    if(m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool IoUring::init(uint32_t entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = io_uring_setup(entries, &params);
+    if(fd < 0) {
+        return false;
+    }
+    m_fd = fd;
+
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    //5.4之后提交队列和完成队列可以一次映射，
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap) {
+        if(m_cqRingSize > m_sqRingSize) {
+            m_sqRingSize = m_cqRingSize;
+        }
+        m_cqRingSize = m_sqRingSize;
+    }
+
+    m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE
+                    ,MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if(m_sqRing == MAP_FAILED) {
+        m_sqRing = nullptr;
+        destroy();
+        return false;
+    }
+    if(single_mmap) {
+        m_cqRing = m_sqRing;
+    } else {
+        m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE
+                    ,MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if(m_cqRing == MAP_FAILED) {
+            m_cqRing = nullptr;
+            destroy();
+            return false;
+        }
+    }
+
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe*)mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE
+                    ,MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(m_sqes == MAP_FAILED) {
+        m_sqes = nullptr;
+        destroy();
+        return false;
+    }
+
+    char* sq = (char*)m_sqRing;
+    m_sqHead = (unsigned*)(sq + params.sq_off.head);
+    m_sqTail = (unsigned*)(sq + params.sq_off.tail);
+    m_sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    m_sqEntries = (unsigned*)(sq + params.sq_off.ring_entries);
+    m_sqArray = (unsigned*)(sq + params.sq_off.array);
+
+    char* cq = (char*)m_cqRing;
+    m_cqHead = (unsigned*)(cq + params.cq_off.head);
+    m_cqTail = (unsigned*)(cq + params.cq_off.tail);
+    m_cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    m_sqeHead = m_sqeTail = *m_sqTail;
+    return true;
+}
+
+uint32_t IoUring::space() const {
+    unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    return *m_sqEntries - (m_sqeTail - head);
+}
+
+io_uring_sqe* IoUring::getSqe() {
+    if(space() == 0) {
+        return nullptr;
+    }
+    io_uring_sqe* sqe = &m_sqes[m_sqeTail & *m_sqMask];
+    ++m_sqeTail;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int IoUring::submit() {
+    //sqe的下标按顺序填进array，再发布tail，
+    unsigned tail = *m_sqTail;
+    unsigned mask = *m_sqMask;
+    unsigned count = m_sqeTail - m_sqeHead;
+    for(unsigned i = 0; i < count; ++i) {
+        m_sqArray[tail & mask] = m_sqeHead & mask;
+        ++tail;
+        ++m_sqeHead;
+    }
+    __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+    if(count == 0) {
+        return 0;
+    }
+    int rt = 0;
+    do {
+        rt = io_uring_enter(m_fd, count, 0, 0);
+    } while(rt < 0 && errno == EINTR);
+    return rt;
+}
+
+int IoUring::reap(io_uring_cqe* cqes, int max) {
+    unsigned head = *m_cqHead;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    unsigned mask = *m_cqMask;
+    int n = 0;
+    while(head != tail && n < max) {
+        cqes[n++] = m_cqes[head & mask];
+        ++head;
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+bool IoUring::registerEventFd(int fd) {
+    return io_uring_register(m_fd, IORING_REGISTER_EVENTFD, &fd, 1) == 0;
+}
+
+}
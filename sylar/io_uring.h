@@ -0,0 +1,65 @@
+#ifndef __SYLAR_IO_URING_H__
+#define __SYLAR_IO_URING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+#include "noncopyable.h"
+
+namespace sylar {
+
+//直接用io_uring_setup/io_uring_enter系统调用，不依赖liburing，
+//提交队列只能由一个线程使用，完成队列由调用者自己加锁，
+class IoUring : public Noncopyable {
+public:
+    IoUring();
+    ~IoUring();
+
+    //entries为提交队列的长度，内核不支持或者被禁止(seccomp)时返回false，
+    bool init(uint32_t entries);
+    bool isValid() const { return m_fd >= 0;}
+
+    //取一个空闲的sqe(已清零)，队列满了返回nullptr，
+    io_uring_sqe* getSqe();
+    //还能取多少个sqe
+    uint32_t space() const;
+    //getSqe之后还没提交给内核的个数，
+    uint32_t pending() const { return m_sqeTail - m_sqeHead;}
+    //提交所有pending的sqe，返回提交的个数，失败返回-1(errno)
+    int submit();
+    //取出最多max个已经完成的cqe，返回个数，
+    int reap(io_uring_cqe* cqes, int max);
+    //有cqe完成时内核会写这个eventfd，可以挂在epoll上，
+    bool registerEventFd(int fd);
+
+private:
+    void destroy();
+
+private:
+    int m_fd = -1;
+    void* m_sqRing = nullptr;
+    size_t m_sqRingSize = 0;
+    void* m_cqRing = nullptr;
+    size_t m_cqRingSize = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+
+    //和内核共享的内存，
+    unsigned* m_sqHead = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned* m_sqMask = nullptr;
+    unsigned* m_sqEntries = nullptr;
+    unsigned* m_sqArray = nullptr;
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    unsigned* m_cqMask = nullptr;
+    io_uring_cqe* m_cqes = nullptr;
+
+    //本地的sqe位置，[m_sqeHead, m_sqeTail)是取出来了还没提交的，
+    unsigned m_sqeHead = 0;
+    unsigned m_sqeTail = 0;
+};
+
+}
+
+#endif
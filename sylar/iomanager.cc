@@ -4,12 +4,84 @@
 #include "unistd.h"
 #include "log.h"
 #include "fcntl.h"
+#include <sys/eventfd.h>
+#include "config.h"
+#include "util.h"
+#include "fd_manager.h"
 
 
 namespace sylar {
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+//idle时阻塞之前是否先空转，低功耗的部署可以关掉，
+static sylar::ConfigVar<bool>::ptr g_iomanager_spin_enable =
+    sylar::Config::Lookup<bool>("iomanager.spin.enable", true, "iomanager spin before park");
+
+//空转时间的上限，单位微秒，实际的空转时间根据最近的空闲时长调整，
+static sylar::ConfigVar<uint32_t>::ptr g_iomanager_spin_max_us =
+    sylar::Config::Lookup<uint32_t>("iomanager.spin.max_us", 50, "iomanager max spin time in us");
+
+//一次epoll_wait最多收多少个事件，
+static sylar::ConfigVar<uint32_t>::ptr g_iomanager_epoll_batch_size =
+    sylar::Config::Lookup<uint32_t>("iomanager.epoll.batch_size", 256, "iomanager epoll_wait max events");
+
+//fd第一次addEvent时按读写边缘触发注册，之后等待/取消事件都不再调用epoll_ctl，
+static sylar::ConfigVar<bool>::ptr g_iomanager_epoll_persistent =
+    sylar::Config::Lookup<bool>("iomanager.epoll.persistent", true, "iomanager persistent edge-triggered registration");
+
+//io后端，epoll或者io_uring，io_uring初始化失败时退回epoll，
+static sylar::ConfigVar<std::string>::ptr g_iomanager_backend =
+    sylar::Config::Lookup<std::string>("iomanager.backend", "epoll", "iomanager io backend, epoll or io_uring");
+
+//每个io_uring提交队列的长度，
+static sylar::ConfigVar<uint32_t>::ptr g_iomanager_uring_entries =
+    sylar::Config::Lookup<uint32_t>("iomanager.io_uring.entries", 256, "iomanager io_uring queue depth");
+
+//配置的镜像，监听器在任意线程写，工作线程读，用relaxed原子变量，
+static std::atomic<bool> s_spin_enable {true};
+static std::atomic<uint32_t> s_spin_max_us {50};
+static std::atomic<uint32_t> s_epoll_batch_size {256};
+
+namespace {
+struct _IOManagerIniter {
+    _IOManagerIniter() {
+        s_spin_enable.store(g_iomanager_spin_enable->getValue(), std::memory_order_relaxed);
+        s_spin_max_us.store(g_iomanager_spin_max_us->getValue(), std::memory_order_relaxed);
+
+        g_iomanager_spin_enable->addListener([](const bool& old_value, const bool& new_value){
+            SYLAR_LOG_INFO(g_logger) << "iomanager spin enable changed from "
+                << old_value << " to " << new_value;
+            s_spin_enable.store(new_value, std::memory_order_relaxed);
+        });
+        g_iomanager_spin_max_us->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            SYLAR_LOG_INFO(g_logger) << "iomanager spin max us changed from "
+                << old_value << " to " << new_value;
+            s_spin_max_us.store(new_value, std::memory_order_relaxed);
+        });
+
+        s_epoll_batch_size.store(g_iomanager_epoll_batch_size->getValue(), std::memory_order_relaxed);
+        g_iomanager_epoll_batch_size->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            SYLAR_LOG_INFO(g_logger) << "iomanager epoll batch size changed from "
+                << old_value << " to " << new_value;
+            s_epoll_batch_size.store(new_value, std::memory_order_relaxed);
+        });
+    }
+};
+static _IOManagerIniter s_iomanager_initer;
+}
+
+//本线程最近几次空闲时长(从进入idle到等到任务)的指数加权平均，单位微秒，
+static thread_local uint64_t t_idle_avg_us = 0;
+
+static inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
 enum EpollCtlOp{
 };
 
@@ -74,11 +146,17 @@ void IOManager::FdContext::resetContext(EventContext& ctx){
     ctx.cb = nullptr;
 }
 
-void IOManager::FdContext::triggerEvent(Event event){
+void IOManager::FdContext::triggerEvent(Event event, TaskBatch* batch){
     SYLAR_ASSERT(events & event);
     events = (Event)(events & ~event);     //triggerEvent函数执行了event对应的事件， 那么event对应的事件就没了， 所以events & ～event返回就是剩下的事件类型了，
     EventContext& ctx = getContext(event);
-    if(ctx.cb) {
+    if(batch && ctx.scheduler == batch->scheduler) {
+        if(ctx.cb) {
+            batch->tasks.emplace_back(&ctx.cb, -1);
+        } else {
+            batch->tasks.emplace_back(&ctx.fiber, -1);
+        }
+    } else if(ctx.cb) {
         ctx.scheduler->schedule(&ctx.cb);
     } else {
         ctx.scheduler->schedule(&ctx.fiber);
@@ -91,65 +169,305 @@ void IOManager::FdContext::triggerEvent(Event event){
 
 
 IOManager::IOManager(size_t threads , bool use_caller , const std::string name)
-    : Scheduler(threads, use_caller, name) {
+    : Scheduler(threads, use_caller, name)
+    , TimerManager(threads) {
+    m_persistent = g_iomanager_epoll_persistent->getValue();
+    for(size_t i = 0; i < threads; ++i) {
+        m_eventsPerWait.push_back(new Histogram());
+    }
     m_epfd = epoll_create(5000);
     SYLAR_ASSERT(m_epfd > 0);
 
-    int rt = pipe(m_tickleFds);
-    SYLAR_ASSERT(!rt);
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC | EFD_SEMAPHORE);
+    SYLAR_ASSERT(m_wakeFd >= 0);
 
+    //水平触发，计数没读完之前，其他阻塞的线程也能被唤醒，
     epoll_event event;
     memset(&event, 0, sizeof(epoll_event));
-    event.events = EPOLLIN | EPOLLET;
-    event.data.fd = m_tickleFds[0];
+    event.events = EPOLLIN;
+    event.data.ptr = &m_wakeFd;
 
-    rt = fcntl(m_tickleFds[0], F_SETFL, O_NONBLOCK);
+    int rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_wakeFd, &event);
     SYLAR_ASSERT(!rt);
 
-    rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);
-    SYLAR_ASSERT(!rt);
+    const std::string& backend = g_iomanager_backend->getValue();
+    if(backend == "io_uring") {
+        if(!initUring(threads)) {
+            SYLAR_LOG_ERROR(g_logger) << "io_uring unavailable (" << errno << ")("
+                << strerror(errno) << "), fall back to epoll";
+            destroyUring();
+        }
+    } else if(backend != "epoll") {
+        SYLAR_LOG_ERROR(g_logger) << "unknown iomanager.backend=" << backend << ", use epoll";
+    }
 
-    contextResize(32, 0);
-    //m_fdContexts.resize(64);
     start();  //开启协程调度器，
 }
 
 IOManager::~IOManager() {
     stop();
+    destroyUring();
     close(m_epfd);
-    close(m_tickleFds[0]);
-    close(m_tickleFds[1]);
+    close(m_wakeFd);
+
+    m_fdContexts.foreach([](size_t fd, std::atomic<FdContext*>& slot){
+        FdContext* fd_ctx = slot.load(std::memory_order_relaxed);
+        if(fd_ctx) {
+            delete fd_ctx;
+        }
+    });
+    for(auto& i : m_eventsPerWait) {
+        delete i;
+    }
+}
 
-    for(size_t i = 0; i < m_fdContexts.size(); ++i) {
-        if(m_fdContexts[i]) {
-            delete m_fdContexts[i];
+bool IOManager::initUring(size_t threads) {
+    for(size_t i = 0; i < threads; ++i) {
+        Ring* ring = new Ring();
+        m_rings.push_back(ring);
+        if(!ring->uring.init(g_iomanager_uring_entries->getValue())) {
+            return false;
+        }
+        ring->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(ring->event_fd < 0 || !ring->uring.registerEventFd(ring->event_fd)) {
+            return false;
+        }
+        //最低位置1，和FdContext区分开，
+        epoll_event event;
+        memset(&event, 0, sizeof(epoll_event));
+        event.events = EPOLLIN;
+        event.data.u64 = (uintptr_t)ring | 1;
+        if(epoll_ctl(m_epfd, EPOLL_CTL_ADD, ring->event_fd, &event)) {
+            return false;
         }
     }
+    SYLAR_LOG_INFO(g_logger) << "iomanager use io_uring, rings=" << m_rings.size();
+    return true;
 }
 
-void IOManager::contextResize(size_t size, size_t old_size) {
-    m_fdContexts.resize(size);
-    for(size_t i = old_size; i < m_fdContexts.size(); ++i){
-        if(!m_fdContexts[i]){
-            m_fdContexts[i] = new FdContext();
-            m_fdContexts[i]->fd = i;
+void IOManager::destroyUring() {
+    for(auto& ring : m_rings) {
+        if(ring->event_fd >= 0) {
+            close(ring->event_fd);
         }
+        delete ring;
     }
+    m_rings.clear();
 }
 
+IOManager::Ring* IOManager::currentRing() const {
+    if(m_rings.empty()) {
+        return nullptr;
+    }
+    int idx = getWorkerIndex();
+    if(idx < 0 || idx >= (int)m_rings.size()) {
+        return nullptr;
+    }
+    return m_rings[idx];
+}
 
-//1 success, 0 retry, -1 error
-int IOManager::addEvent(int fd, Event event, std::function<void()> cb){     //添加 fd的event类型的事件， 回调事件时cb，
-    FdContext* fd_ctx = nullptr;
-    RWMutexType::Readlock lock(m_mutex);
-    if(m_fdContexts.size() > (size_t)fd){   
-        fd_ctx = m_fdContexts[fd];
-        lock.unlock();
+bool IOManager::submitUring(const io_uring_sqe& sqe, uint64_t timeout_ms, int& res) {
+    Ring* ring = currentRing();
+    if(!ring) {
+        return false;
+    }
+    SYLAR_ASSERT(!ring->pending);
+    FdContext* fd_ctx = getFdContext(sqe.fd, true);
+    if(!fd_ctx) {
+        return false;
+    }
+
+    UringRequest req;
+    req.scheduler = Scheduler::GetThis();
+    req.fiber = Fiber::GetThis();
+    req.sqe = sqe;
+    req.ring = ring;
+    req.fd_ctx = fd_ctx;
+    req.has_timeout = timeout_ms != (uint64_t)-1;
+    if(req.has_timeout) {
+        req.ts.tv_sec = timeout_ms / 1000;
+        req.ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+    }
+    {
+        FdContext::MutexType::Lock lock(fd_ctx->mutex);
+        linkUring(fd_ctx, &req);
+    }
+    ring->pending = &req;
+    ++m_pendingEventCount;
+    Fiber::YieldToHold();     //由onTaskSwitched提交，完成后reapUring调度回来，
+
+    res = req.res;
+    if(res == -ECANCELED && req.has_timeout && !req.cancelled) {
+        res = -ETIMEDOUT;
+    }
+    return true;
+}
+
+void IOManager::onTaskSwitched() {
+    Ring* ring = currentRing();
+    if(!ring || !ring->pending) {
+        return;
+    }
+    UringRequest* req = ring->pending;
+    ring->pending = nullptr;
+
+    FdContext::MutexType::Lock lock(req->fd_ctx->mutex);
+    if(!req->cancelled) {
+        Spinlock::Lock sq_lock(ring->sq_mutex);
+        uint32_t need = req->has_timeout ? 2 : 1;
+        if(ring->uring.space() < need) {
+            ring->uring.submit();
+        }
+        if(ring->uring.space() >= need) {
+            io_uring_sqe* s = ring->uring.getSqe();
+            *s = req->sqe;
+            s->user_data = (uintptr_t)req;
+            //超时用链接的LINK_TIMEOUT，到时间内核取消前一个请求，它自己的cqe的user_data为0，
+            if(req->has_timeout) {
+                s->flags |= IOSQE_IO_LINK;
+                io_uring_sqe* t = ring->uring.getSqe();
+                t->opcode = IORING_OP_LINK_TIMEOUT;
+                t->addr = (uintptr_t)&req->ts;
+                t->len = 1;
+                t->user_data = 0;
+            }
+            req->submitted = true;
+            if(ring->uring.submit() < 0) {
+                SYLAR_LOG_ERROR(g_logger) << "io_uring_enter error (" << errno << ")("
+                    << strerror(errno) << ")";
+            }
+            return;
+        }
+        req->res = -EAGAIN;     //提交队列满了，调用者退回epoll，
     } else {
-        lock.unlock();
-        RWMutexType::WriteLock lock2(m_mutex);
-        contextResize(m_fdContexts.size() * 1.5, m_fdContexts.size());
-        fd_ctx = m_fdContexts[fd];
+        req->res = -ECANCELED;  //挂起之前就被cancelAll取消了，不用交给内核，
+    }
+    unlinkUring(req->fd_ctx, req);
+    lock.unlock();
+    --m_pendingEventCount;
+    req->scheduler->schedule(&req->fiber);
+}
+
+void IOManager::linkUring(FdContext* fd_ctx, UringRequest* req) {
+    req->prev = nullptr;
+    req->next = fd_ctx->uring_reqs;
+    if(req->next) {
+        req->next->prev = req;
+    }
+    fd_ctx->uring_reqs = req;
+}
+
+void IOManager::unlinkUring(FdContext* fd_ctx, UringRequest* req) {
+    if(req->prev) {
+        req->prev->next = req->next;
+    } else {
+        fd_ctx->uring_reqs = req->next;
+    }
+    if(req->next) {
+        req->next->prev = req->prev;
+    }
+    req->prev = req->next = nullptr;
+}
+
+size_t IOManager::cancelUring(FdContext* fd_ctx) {
+    size_t count = 0;
+    for(UringRequest* req = fd_ctx->uring_reqs; req; req = req->next) {
+        if(req->cancelled) {
+            continue;
+        }
+        req->cancelled = true;
+        ++count;
+        if(!req->submitted) {   //还没提交，onTaskSwitched看到cancelled直接结束它，
+            continue;
+        }
+        //ASYNC_CANCEL必须提交到请求所在的io_uring，请求在链表上说明还没完成，user_data不会被复用，
+        Ring* ring = req->ring;
+        Spinlock::Lock sq_lock(ring->sq_mutex);
+        if(ring->uring.space() < 1) {
+            ring->uring.submit();
+        }
+        io_uring_sqe* s = ring->uring.getSqe();
+        if(!s) {
+            SYLAR_LOG_ERROR(g_logger) << "io_uring cancel fd=" << fd_ctx->fd << " sq full";
+            continue;
+        }
+        s->opcode = IORING_OP_ASYNC_CANCEL;
+        s->fd = -1;
+        s->addr = (uintptr_t)req;
+        s->user_data = 0;
+        if(ring->uring.submit() < 0) {
+            SYLAR_LOG_ERROR(g_logger) << "io_uring_enter error (" << errno << ")("
+                << strerror(errno) << ")";
+        }
+    }
+    return count;
+}
+
+void IOManager::reapUring(Ring* ring, TaskBatch& batch) {
+    uint64_t dummy;     //先清掉计数，之后完成的cqe会再写一次，
+    if(read(ring->event_fd, &dummy, sizeof(dummy)) < 0 && errno != EAGAIN) {
+        SYLAR_LOG_ERROR(g_logger) << "read io_uring eventfd error (" << errno << ")";
+    }
+    static const int MAX_CQES = 64;
+    io_uring_cqe cqes[MAX_CQES];
+    int n = 0;
+    do {
+        {
+            Spinlock::Lock lock(ring->mutex);
+            n = ring->uring.reap(cqes, MAX_CQES);
+        }
+        for(int i = 0; i < n; ++i) {
+            if(!cqes[i].user_data) {
+                continue;
+            }
+            UringRequest* req = (UringRequest*)(uintptr_t)cqes[i].user_data;
+            {
+                FdContext::MutexType::Lock lock(req->fd_ctx->mutex);
+                unlinkUring(req->fd_ctx, req);
+            }
+            req->res = cqes[i].res;
+            //fiber被move走之后协程随时可能恢复，不能再访问req，
+            if(req->scheduler == batch.scheduler) {
+                batch.tasks.emplace_back(&req->fiber, -1);
+            } else {
+                req->scheduler->schedule(&req->fiber);
+            }
+            --m_pendingEventCount;
+        }
+    } while(n == MAX_CQES);
+}
+
+//FdContext在第一次addEvent时才由注册事件的线程创建，
+//这样FdContext的内存落在使用它的工作线程的numa节点上(first-touch)，
+IOManager::FdContext* IOManager::getFdContext(int fd, bool auto_create) {
+    if(fd < 0) {
+        return nullptr;
+    }
+    std::atomic<FdContext*>* slot = m_fdContexts.at(fd, auto_create);
+    if(!slot) {
+        return nullptr;
+    }
+    FdContext* fd_ctx = slot->load(std::memory_order_acquire);
+    if(fd_ctx || !auto_create) {
+        return fd_ctx;
+    }
+    FdContext* created = new FdContext();
+    created->fd = fd;
+    if(!slot->compare_exchange_strong(fd_ctx, created
+                ,std::memory_order_acq_rel, std::memory_order_acquire)) {
+        delete created;      //其他线程先创建了，
+        return fd_ctx;
+    }
+    return created;
+}
+
+
+//1 success, 0 retry, -1 error
+int IOManager::addEvent(int fd, Event event, Task cb){     //添加 fd的event类型的事件， 回调事件时cb，
+    FdContext* fd_ctx = getFdContext(fd, true);
+    if(!fd_ctx) {
+        SYLAR_LOG_ERROR(g_logger) << "addEvent fd=" << fd << " out of range";
+        return -1;
     }
 
     FdContext::MutexType::Lock lock3(fd_ctx->mutex);
@@ -160,17 +478,52 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb){     //
         SYLAR_ASSERT(!(fd_ctx->events & event)); 
     }
 
-    int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;    //确定到底是修改红黑树上的节点还是添加，
-    epoll_event epevent;
-    epevent.events = EPOLLET | fd_ctx->events | event;   //将EPOLLIN 和 EPOLLOUT或给events，
-    epevent.data.ptr = fd_ctx;
+    if(m_persistent) {
+        //fd关闭时没有经过本IOManager的cancelAll(其他IOManager的线程、没有hook)，内核已经把它从epoll上删掉了，
+        //fd号被复用之后代数不同，旧的注册和没人等的就绪事件都不能再用，
+        uint64_t generation = FdMgr::GetInstance()->getGeneration(fd);
+        if(fd_ctx->registered && fd_ctx->generation != generation) {
+            fd_ctx->registered = false;
+            fd_ctx->ready = NONE;
+        }
+        if(fd_ctx->ready & event) {     //上次边缘触发时没有人在等，不用再等了，
+            fd_ctx->ready &= ~event;
+            if(!cb) {
+                return 1;
+            }
+            Scheduler* scheduler = Scheduler::GetThis();
+            (scheduler ? scheduler : this)->schedule(&cb);
+            return 0;
+        }
+        //读写都监听，只在第一次等待时ADD，之后每次等待只改等待者，不用epoll_ctl，
+        //旧的fd可能还留在epoll上(dup出来的fd还开着)，这时返回EEXIST，
+        if(!fd_ctx->registered) {
+            epoll_event epevent;
+            epevent.events = EPOLLET | EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+            epevent.data.ptr = fd_ctx;
+            int rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, fd, &epevent);
+            if(rt && errno != EEXIST) {
+                SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+                    << (EpollCtlOp)EPOLL_CTL_ADD << ", " <<fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
+                    << rt <<" (" << errno << ")(" << strerror(errno) << ")";
+                return -1;
+            }
+            fd_ctx->registered = true;
+            fd_ctx->generation = generation;
+        }
+    } else {
+        int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;    //确定到底是修改红黑树上的节点还是添加，
+        epoll_event epevent;
+        epevent.events = EPOLLET | fd_ctx->events | event;   //将EPOLLIN 和 EPOLLOUT或给events，
+        epevent.data.ptr = fd_ctx;
 
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-            << op << ", " <<fd << ", " << epevent.events << "):"
-            << rt <<" (" << errno << ")(" << strerror(errno) << ")";
-            return -1;
+        int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+        if(rt) {
+            SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+                << op << ", " <<fd << ", " << epevent.events << "):"
+                << rt <<" (" << errno << ")(" << strerror(errno) << ")";
+                return -1;
+        }
     }
 
     ++m_pendingEventCount;
@@ -194,30 +547,30 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb){     //
 }
 
 bool IOManager::delEvent(int fd, Event event){
-    RWMutexType::Readlock lock(m_mutex);
-    if((int)m_fdContexts.size() <= fd){
+    FdContext* fd_ctx = getFdContext(fd, false);
+    if(!fd_ctx) {
         return false;
     }
-    FdContext* fd_ctx = m_fdContexts[fd];
-    lock.unlock();
 
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
-    if(!fd_ctx->events & event) {   //很明显，events中没有event类型的事件，
+    if(!(fd_ctx->events & event)) {   //很明显，events中没有event类型的事件，
         return false;
     }
 
     Event new_events = (Event)(fd_ctx->events & ~event);   //new_events等于 fd_ctx->events去除event类型，
-    int op = new_events ? EPOLL_CTL_MOD :EPOLL_CTL_DEL;  //如果原来fd_ctx->events不止有event类型，   那么epoll_ctl就是修改，
-    epoll_event epevent;
-    epevent.events = EPOLLET | new_events;
-    epevent.data.ptr = fd_ctx;
-
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-            << op << ", " <<fd << ", " << epevent.events << "):"
-            << rt <<" (" << errno << ")(" << strerror(errno) << ")";
-            return false;
+    if(!m_persistent) {     //持久注册时fd一直留在epoll上，只清掉等待者，
+        int op = new_events ? EPOLL_CTL_MOD :EPOLL_CTL_DEL;  //如果原来fd_ctx->events不止有event类型，   那么epoll_ctl就是修改，
+        epoll_event epevent;
+        epevent.events = EPOLLET | new_events;
+        epevent.data.ptr = fd_ctx;
+
+        int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+        if(rt) {
+            SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+                << op << ", " <<fd << ", " << epevent.events << "):"
+                << rt <<" (" << errno << ")(" << strerror(errno) << ")";
+                return false;
+        }
     }
 
     --m_pendingEventCount;
@@ -229,30 +582,30 @@ bool IOManager::delEvent(int fd, Event event){
 }
 
 bool IOManager::cancelEvent(int fd, Event event){
-    RWMutexType::Readlock lock(m_mutex);
-    if((int)m_fdContexts.size() <= fd){
+    FdContext* fd_ctx = getFdContext(fd, false);
+    if(!fd_ctx) {
         return false;
     }
-    FdContext* fd_ctx = m_fdContexts[fd];
-    lock.unlock();
 
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
-    if(!fd_ctx->events & event) {
+    if(!(fd_ctx->events & event)) {
         return false;
     }
 
-    Event new_events = (Event)(fd_ctx->events & ~event); 
-    int op = new_events ? EPOLL_CTL_MOD :EPOLL_CTL_DEL;
-    epoll_event epevent;
-    epevent.events = EPOLLET | new_events;
-    epevent.data.ptr = fd_ctx;
+    if(!m_persistent) {
+        Event new_events = (Event)(fd_ctx->events & ~event); 
+        int op = new_events ? EPOLL_CTL_MOD :EPOLL_CTL_DEL;
+        epoll_event epevent;
+        epevent.events = EPOLLET | new_events;
+        epevent.data.ptr = fd_ctx;
 
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-            << op << ", " <<fd << ", " << epevent.events << "):"
-            << rt <<" (" << errno << ")(" << strerror(errno) << ")";
-            return false;
+        int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+        if(rt) {
+            SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+                << op << ", " <<fd << ", " << epevent.events << "):"
+                << rt <<" (" << errno << ")(" << strerror(errno) << ")";
+                return false;
+        }
     }
 
     fd_ctx->triggerEvent(event);   //cancleEvent函数最后会触发event-EventContex，
@@ -261,16 +614,20 @@ bool IOManager::cancelEvent(int fd, Event event){
 }
 
 bool IOManager::cancelAll(int fd){
-    RWMutexType::Readlock lock(m_mutex);
-    if((int)m_fdContexts.size() <= fd){
+    FdContext* fd_ctx = getFdContext(fd, false);
+    if(!fd_ctx) {
         return false;
     }
-    FdContext* fd_ctx = m_fdContexts[fd];
-    lock.unlock();
 
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
-    if(!fd_ctx->events) {
-        return false;
+    //io_uring里的请求持有文件的引用，不取消的话fd关闭之后连接也不会真正关闭，
+    bool cancelled = fd_ctx->uring_reqs && cancelUring(fd_ctx) > 0;
+    //fd要关闭了，持久注册的fd即使没有等待者也要从epoll上删掉，fd号可能被复用，
+    bool registered = fd_ctx->registered;
+    fd_ctx->registered = false;
+    fd_ctx->ready = NONE;
+    if(!fd_ctx->events && !registered) {
+        return cancelled;
     }
 
     int op = EPOLL_CTL_DEL;
@@ -279,7 +636,8 @@ bool IOManager::cancelAll(int fd){
     epevent.data.ptr = fd_ctx;
 
     int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
+    //ENOENT: 旧的fd关闭时内核已经删掉了，registered只是过期了，等待者照样要唤醒，
+    if(rt && errno != ENOENT) {
         SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
             << op << ", " <<fd << ", " << epevent.events << "):"
             << rt <<" (" << errno << ")(" << strerror(errno) << ")";
@@ -307,119 +665,256 @@ IOManager* IOManager::GetThis(){
 
 
 void IOManager::tickle() {
-    if(!hasIdleThreads()){
-        return ;
+    //和idle()里先++m_parkedCount再检查任务队列配对，保证不会漏掉唤醒，
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    //只在阻塞的线程比已经发出的唤醒多时才写eventfd，每次只唤醒一个线程，
+    size_t pending = m_pendingWakeups;
+    while(true) {
+        if(pending >= m_parkedCount || m_spinningCount > 0) {
+            ++m_tickleSkipped;
+            return;
+        }
+        if(m_pendingWakeups.compare_exchange_weak(pending, pending + 1)) {
+            break;
+        }
     }
-    int rt = write(m_tickleFds[1], "T", 1);   //写入一个字符，监听这个m_tickleFds[0]的事件就会被触发，
-    SYLAR_ASSERT(rt == 1);
-}
-
-bool IOManager::stopping(uint64_t& timeout) {
-    timeout = getNextTimer();
-    return timeout == ~0ull
-        && m_pendingEventCount == 0
-        && Scheduler::stopping();
-}   
-
-
-bool IOManager::stopping() {
-    uint64_t timeout = 0;
-    return stopping(timeout);
+    uint64_t one = 1;
+    int rt = write(m_wakeFd, &one, sizeof(one));
+    SYLAR_ASSERT(rt == sizeof(one));
+    ++m_tickleCount;
 }
 
-
-void IOManager::idle() {
-    epoll_event* events = new epoll_event[64]();
-    std::shared_ptr<epoll_event> shared_events(events, [](epoll_event* ptr){  //不需要用到智能指针，主要是自动释放，
-        delete[] ptr;
-    });
-
-    uint64_t next_timeout = 0;
-    while(true) {
-        next_timeout = getNextTimer();
-        if(stopping(next_timeout)) {
-            SYLAR_LOG_INFO(g_logger) <<"name =" << getName() << " idle stopping exit";
+int IOManager::spinWait(epoll_event* events, int max_events) {
+    uint32_t spin_max_us = s_spin_max_us.load(std::memory_order_relaxed);
+    if(!s_spin_enable.load(std::memory_order_relaxed) || !spin_max_us) {
+        return -1;
+    }
+    //最近空闲时长比上限短，空转大概率能等到任务，空转到平均值的两倍，否则不空转直接阻塞，
+    uint64_t budget = t_idle_avg_us * 2;
+    if(t_idle_avg_us >= spin_max_us) {
+        return -1;
+    }
+    budget = std::max<uint64_t>(budget, spin_max_us / 4);
+    budget = std::min<uint64_t>(budget, spin_max_us);
+
+    int rt = -1;
+    ++m_spinningCount;
+    uint64_t start = sylar::GetCurrentUS();
+    for(uint32_t i = 0; ; ++i) {
+        //有任务时要加锁扫描队列，隔一轮才扫一次，少和工作线程抢队列的锁，
+        if((i & 1) == 0 && hasRunnableTask()) {
+            rt = 0;
             break;
         }
+        //epoll_wait(0)是系统调用，隔几轮才调用一次，
+        if((i & 7) == 7) {
+            int n = epoll_wait(m_epfd, events, max_events, 0);
+            if(n > 0) {
+                recordWait(n, max_events);
+                rt = n;
+                break;
+            }
+            if(sylar::GetCurrentUS() - start >= budget) {
+                break;
+            }
+        }
+        CpuRelax();
     }
+    --m_spinningCount;
+    if(rt >= 0) {
+        ++m_spinHits;
+    } else if(hasTaskForIdleWorkers()) {
+        //空转期间tickle被跳过了，但任务指定的是其他线程，本线程取不到，要把唤醒补上，
+        tickle();
+    }
+    return rt;
+}
 
-   
+int IOManager::park(epoll_event* events, int max_events) {
+    uint64_t next_timeout = 0;
+    //先登记为阻塞状态再检查，这之后的tickle()一定能看到本线程，
+    ++m_parkedCount;
+    if(stopping(next_timeout)) {
+        --m_parkedCount;
+        return -1;
+    }
+    if(hasRunnableTask()) {
+        next_timeout = 0;     //登记之前已经有任务入队了，只收一下就绪的事件，不阻塞，
+    }
 
-    int rt = 0;  //有多少个epoll事件被监听到了，
+    int rt = 0;
     do {
         static const int MAX_TIMEOUT = 5000;   //单位是毫秒
         if(next_timeout != ~0ull) {
-            next_timeout = (int)next_timeout > MAX_TIMEOUT
+            next_timeout = next_timeout > (uint64_t)MAX_TIMEOUT
                                     ? MAX_TIMEOUT : next_timeout;
         }else {
             next_timeout = MAX_TIMEOUT;
         }
-        rt = epoll_wait(m_epfd, events, 64, (int)next_timeout);       //循环监听是否有事件被触发，
+        rt = epoll_wait(m_epfd, events, max_events, (int)next_timeout);       //循环监听是否有事件被触发，
         if(rt < 0 && errno ==EINTR) {
         } else {
             break;
         }
     } while (true);
+    --m_parkedCount;
+    rt = rt < 0 ? 0 : rt;
+    recordWait(rt, max_events);
+    return rt;
+}
 
-    std::vector<std::function<void()> > cbs;
-    listExpiredCb(cbs);
-    if(!cbs.empty()) {
-        schedule(cbs.begin(), cbs.end());
-        cbs.clear();
+void IOManager::recordWait(int n, int max_events) {
+    int idx = getWorkerIndex();
+    if(idx >= 0 && idx < (int)m_eventsPerWait.size()) {
+        m_eventsPerWait[idx]->record(n);
     }
-    
-    for(int i = 0;i < rt; ++i) {
-        epoll_event& event = events[i];
-        if(event.data.fd == m_tickleFds[0]){
-            uint8_t dummy;
-            while(read(m_tickleFds[0], &dummy, 1) == 1);
-            continue;
-        }
+    if(n >= max_events) {
+        ++m_epollFull;
+    }
+}
 
-        FdContext* fd_ctx = (FdContext*)event.data.ptr;   //在addevent时， fdcontext被保存到了event_epoll.data.ptr里面了，
-        FdContext::MutexType::Lock lock(fd_ctx->mutex);
-        if(event.events & (EPOLLERR | EPOLLHUP)) {
-            event.events |= EPOLLIN |EPOLLOUT;
-        }
-        int real_events = NONE;
-        if(event.events & EPOLLIN) {
-            real_events |= READ;
+void IOManager::getEventsPerWait(Histogram& hist) const {
+    for(auto& i : m_eventsPerWait) {
+        hist.merge(*i);
+    }
+}
+
+bool IOManager::stopping(uint64_t& timeout) {
+    timeout = getNextTimer();
+    return timeout == ~0ull
+        && m_pendingEventCount == 0
+        && Scheduler::stopping();
+}   
+
+
+bool IOManager::stopping() {
+    uint64_t timeout = 0;
+    return stopping(timeout);
+}
+
+
+void IOManager::idle() {
+    //大小跟着iomanager.epoll.batch_size变，
+    std::vector<epoll_event> events;
+
+    //每轮循环复用，避免反复分配内存，
+    std::vector<Task> cbs;
+    TaskBatch batch;
+    batch.scheduler = this;
+
+    while(true) {
+        size_t max_events = std::max<uint32_t>(s_epoll_batch_size.load(std::memory_order_relaxed), 1);
+        if(events.size() != max_events) {
+            events.resize(max_events);
         }
-        if(event.events & EPOLLOUT) {
-            real_events |= WRITE;
+        uint64_t idle_start = sylar::GetCurrentUS();
+        int rt = spinWait(&events[0], max_events);  //有多少个epoll事件被监听到了，
+        if(rt < 0) {
+            rt = park(&events[0], max_events);
+            if(rt < 0) {
+                SYLAR_LOG_INFO(g_logger) <<"name =" << getName() << " idle stopping exit";
+                break;
+            }
         }
+        //更新平均空闲时长，权重1/8，
+        uint64_t idle_us = sylar::GetCurrentUS() - idle_start;
+        t_idle_avg_us = (t_idle_avg_us * 7 + idle_us) / 8;
 
-        if((fd_ctx->events & real_events) == NONE) {  //再次判断是否fd_ctx有对于的事件需要处理，
-            continue;
+        listExpiredCb(cbs);
+        for(auto& cb : cbs) {
+            batch.tasks.emplace_back(&cb, -1);
         }
+        cbs.clear();
 
-        int left_events = (fd_ctx->events & ~real_events);   //left_events保存了fd_ctx没有监听到的事件，也就是不需要处理的事件
-        int op =left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-        event.events = EPOLLET | left_events;     //需要修改epoll红黑树上的fd需要监听的事件，
-
-        int rt2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
-        if(rt2) {
-            SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                    << op << ", " <<fd_ctx->fd << ", " << event.events << "):"
-                     << rt <<" (" << errno << ")(" << strerror(errno) << ")";
-            continue;
+        for(int i = 0;i < rt; ++i) {
+            epoll_event& event = events[i];
+            if(event.data.ptr == &m_wakeFd){
+                uint64_t dummy;    //EFD_SEMAPHORE，一次只读走一个唤醒，剩下的留给其他线程，
+                if(read(m_wakeFd, &dummy, sizeof(dummy)) == sizeof(dummy)) {
+                    --m_pendingWakeups;
+                }
+                continue;
+            }
+
+            if(event.data.u64 & 1) {
+                reapUring((Ring*)(uintptr_t)(event.data.u64 & ~1ull), batch);
+                continue;
+            }
+
+            FdContext* fd_ctx = (FdContext*)event.data.ptr;   //在addevent时， fdcontext被保存到了event_epoll.data.ptr里面了，
+            FdContext::MutexType::Lock lock(fd_ctx->mutex);
+            if(event.events & (EPOLLERR | EPOLLHUP)) {
+                event.events |= m_persistent ? (EPOLLIN | EPOLLOUT)
+                                    : (EPOLLIN | EPOLLOUT) & fd_ctx->events;
+            }
+            if(event.events & EPOLLRDHUP) {
+                event.events |= EPOLLIN;
+            }
+            int real_events = NONE;
+            if(event.events & EPOLLIN) {
+                real_events |= READ;
+            }
+            if(event.events & EPOLLOUT) {
+                real_events |= WRITE;
+            }
+
+            if(m_persistent) {
+                //边缘触发只通知一次，没有人在等的事件记下来，下次addEvent直接返回，
+                fd_ctx->ready |= real_events & ~fd_ctx->events;
+                real_events &= fd_ctx->events;
+                if(real_events & READ) {
+                    fd_ctx->triggerEvent(READ, &batch);
+                    --m_pendingEventCount;
+                }
+                if(real_events & WRITE) {
+                    fd_ctx->triggerEvent(WRITE, &batch);
+                    --m_pendingEventCount;
+                }
+                continue;
+            }
+
+            if((fd_ctx->events & real_events) == NONE) {  //再次判断是否fd_ctx有对于的事件需要处理，
+                continue;
+            }
+
+            int left_events = (fd_ctx->events & ~real_events);   //left_events保存了fd_ctx没有监听到的事件，也就是不需要处理的事件
+            int op =left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+            event.events = EPOLLET | left_events;     //需要修改epoll红黑树上的fd需要监听的事件，
+
+            int rt2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
+            if(rt2) {
+                SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+                        << op << ", " <<fd_ctx->fd << ", " << event.events << "):"
+                         << rt2 <<" (" << errno << ")(" << strerror(errno) << ")";
+                continue;
+            }
+
+            if(real_events & READ) {
+                fd_ctx->triggerEvent(READ, &batch);
+                --m_pendingEventCount;
+            }
+            if(real_events & WRITE) {
+                fd_ctx->triggerEvent(WRITE, &batch);
+                --m_pendingEventCount;
+            }
         }
 
-        if(real_events & READ) {
-            fd_ctx->triggerEvent(READ);
-            --m_pendingEventCount;
+        //超时的定时器和就绪的事件一次性放进任务队列，只加一次锁，只tickle一次，
+        if(!batch.tasks.empty()) {
+            scheduleBatch(batch.tasks);
+            batch.tasks.clear();
         }
-        if(real_events & WRITE) {
-            fd_ctx->triggerEvent(WRITE);
-            --m_pendingEventCount;
+        //本线程只能执行一个任务，还有别的线程能执行的任务就把唤醒传给下一个阻塞的线程，
+        if(hasTaskForIdleWorkers()) {
+            tickle();
         }
-    }
-    Fiber::ptr cur = Fiber::GetThis();
-    //下面两行代码是为了释放内存，
-    auto raw_ptr = cur.get();
-    cur.reset();
-    raw_ptr->swapOut();
 
+        Fiber::ptr cur = Fiber::GetThis();
+        //下面两行代码是为了释放内存，
+        auto raw_ptr = cur.get();
+        cur.reset();
+        raw_ptr->swapOut();
+    }
 }
 
 
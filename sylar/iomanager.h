@@ -5,9 +5,13 @@
 #include <memory>
 #include "thread.h"
 #include "timer.h"
+#include "task.h"
+#include "io_uring.h"
+#include "segmented_table.h"
 #include <functional>
 #include <atomic>
 #include <vector>
+#include <sys/epoll.h>
 
 
 namespace sylar {
@@ -24,24 +28,38 @@ public:
     };
 
 private:
+    struct UringRequest;
 
+    //一次epoll_wait就绪的事件先收集到这里，最后一次性交给调度器，
+    struct TaskBatch {
+        Scheduler* scheduler = nullptr;
+        std::vector<FiberAndThread> tasks;
+    };
 
     struct FdContext {
         typedef Mutex MutexType;
         struct EventContext {
             Scheduler* scheduler = nullptr; //事件执行的scheduler
             Fiber::ptr fiber;               //事件协程
-            std::function<void()> cb;       //事件的回调函数，
+            Task cb;                        //事件的回调函数，
         };
 
         EventContext& getContext(Event event);
         void resetContext(EventContext& ctx);
-        void triggerEvent(Event event);
+        //batch不为空并且事件属于batch->scheduler时，任务放进batch，由调用者统一调度，
+        void triggerEvent(Event event, TaskBatch* batch = nullptr);
 
         EventContext read;    //读事件，
         EventContext write;   //写事件,
         int fd = 0;               //事件关联的句柄
         Event events = NONE; //已经注册的事件，
+        //持久注册(iomanager.epoll.persistent)时使用，
+        bool registered = false;  //是否已经加到epoll上，
+        //加到epoll时fd在FdMgr里的代数，fd关闭后号被复用时代数会变，这时要重新ADD，
+        //没有被FdMgr管理的fd代数为0，关闭之前必须调用cancelAll，
+        uint64_t generation = 0;
+        int ready = NONE;         //边缘触发时没有人在等的事件，下次addEvent直接返回，
+        UringRequest* uring_reqs = nullptr;     //这个fd上还没完成的io_uring请求，cancelAll时取消，
         MutexType mutex;
     };
 
@@ -51,15 +69,37 @@ public:
     ~IOManager();
     
     //0 success, -1 error
-    int addEvent(int fd, Event event, std::function<void()> cb = nullptr);
+    //持久注册时，事件在上次边缘触发后还没有被消费，不注册直接返回1，调用者应该重试io而不是yield，
+    //有cb时不会返回1，而是直接调度cb，
+    int addEvent(int fd, Event event, Task cb = nullptr);
 
     //删除事件fd对应的fdcontext中的event-EventContext事件，不会触发event-EventContext事件，
     bool delEvent(int fd, Event event);
     //删除事件fd对应的fdcontext中的event-EventContext事件，会触发event-EventContext事件，
     bool cancelEvent(int fd, Event event);
+    //触发fd上所有等待的事件，并取消fd上还在io_uring里的请求，关闭fd之前调用，
     bool cancelAll(int fd);
 
-    bool hasIdleThreads() { return m_idLeThreadCount == 0; }
+    bool hasIdleThreads() { return m_idLeThreadCount > 0; }
+
+    //真正写了eventfd的tickle次数，
+    uint64_t getTickleCount() const { return m_tickleCount;}
+    //没有线程阻塞在epoll_wait(或者唤醒已经在路上)而省掉的tickle次数，
+    uint64_t getTickleSkipped() const { return m_tickleSkipped;}
+    //空转阶段就等到了任务/事件，没有阻塞的次数，
+    uint64_t getSpinHits() const { return m_spinHits;}
+    //每次epoll_wait收到的事件数的分布，count是epoll_wait返回的次数，sum是事件总数，
+    void getEventsPerWait(Histogram& hist) const;
+    //一次收满iomanager.epoll.batch_size个事件的次数，太多说明batch_size太小，
+    uint64_t getEpollFullCount() const { return m_epollFull;}
+
+    //iomanager.backend为io_uring并且当前线程是本IOManager的工作线程时可用，
+    bool hasUring() const { return currentRing() != nullptr;}
+    //把sqe(不用填user_data)提交到当前线程的io_uring，挂起当前协程直到完成，
+    //res是内核返回的结果，失败时为-errno，超时为-ETIMEDOUT，timeout_ms为-1表示不超时，
+    //cancelAll(sqe.fd)取消时为-ECANCELED，提交队列满了为-EAGAIN，
+    //io_uring不可用时返回false，
+    bool submitUring(const io_uring_sqe& sqe, uint64_t timeout_ms, int& res);
 
     static IOManager* GetThis();
 
@@ -68,16 +108,76 @@ protected:
     bool stopping() override;
     void idle() override;
     bool stopping(uint64_t& timeout);
-    void contextResize(size_t size, size_t old_size)
+    //fd对应的FdContext，auto_create为true时不存在就创建，
+    FdContext* getFdContext(int fd, bool auto_create);
+    //阻塞之前先空转一小段时间，轮询任务队列和epoll_wait(0)，
+    //返回-1表示空转预算用完了还没有任务，否则返回收到的epoll事件数，
+    int spinWait(epoll_event* events, int max_events);
+    //阻塞在epoll_wait上，直到有事件、被tickle或者定时器超时，返回-1表示调度器要停止了，
+    int park(epoll_event* events, int max_events);
+    //记录一次epoll_wait收到的事件数，
+    void recordWait(int n, int max_events);
+    //协程让出之后才把sqe交给内核，避免完成时协程还在执行，
+    void onTaskSwitched() override;
     void onTimeInsertedAtFront() override;
+    //每个工作线程一个定时器分片，
+    int timerShardIndex() override { return getWorkerIndex();}
+private:
+    //每个工作线程一个io_uring，提交队列只有所属线程用，完成队列谁被epoll唤醒谁处理，
+    struct Ring {
+        IoUring uring;
+        int event_fd = -1;       //有cqe时内核写这个eventfd，挂在m_epfd上，
+        Spinlock mutex;          //完成队列的锁
+        //提交队列的锁，所属线程提交请求，其他线程cancelAll时提交ASYNC_CANCEL，
+        //sqe总是在锁内取出并马上提交，锁外提交队列里没有没提交的sqe，
+        Spinlock sq_mutex;
+        UringRequest* pending = nullptr;    //协程挂起之后才提交的请求，只有所属线程访问，
+    };
+    //在协程栈上，协程挂起期间一直有效，挂在fd的FdContext上直到完成，
+    struct UringRequest {
+        Scheduler* scheduler = nullptr;
+        Fiber::ptr fiber;
+        int res = 0;
+        io_uring_sqe sqe;
+        bool has_timeout = false;
+        __kernel_timespec ts;
+        Ring* ring = nullptr;
+        FdContext* fd_ctx = nullptr;
+        //下面的字段由fd_ctx->mutex保护，
+        bool submitted = false;     //已经交给内核了，
+        bool cancelled = false;     //被cancelAll取消了，
+        UringRequest* prev = nullptr;
+        UringRequest* next = nullptr;
+    };
+
+    bool initUring(size_t threads);
+    void destroyUring();
+    Ring* currentRing() const;
+    void reapUring(Ring* ring, TaskBatch& batch);
+    //fd_ctx->mutex已经加锁，
+    void linkUring(FdContext* fd_ctx, UringRequest* req);
+    void unlinkUring(FdContext* fd_ctx, UringRequest* req);
+    //fd_ctx->mutex已经加锁，取消fd上所有在途的请求，返回取消的个数，
+    size_t cancelUring(FdContext* fd_ctx);
 private:
     int m_epfd = 0;
-    int m_tickleFds[2];
+    //EFD_SEMAPHORE的eventfd，水平触发，每写一次只唤醒一个阻塞在epoll_wait上的线程，
+    int m_wakeFd = -1;
+    std::atomic<size_t> m_parkedCount = {0};      //阻塞(或即将阻塞)在epoll_wait上的线程数，
+    std::atomic<size_t> m_pendingWakeups = {0};   //已经写入eventfd还没有被读走的唤醒数，
+    std::atomic<size_t> m_spinningCount = {0};    //正在空转的线程数，它们自己会发现新任务，不需要唤醒，
+    std::atomic<uint64_t> m_spinHits = {0};
+    std::atomic<uint64_t> m_tickleCount = {0};
+    std::atomic<uint64_t> m_tickleSkipped = {0};
+    std::atomic<uint64_t> m_epollFull = {0};
+    std::vector<Histogram*> m_eventsPerWait;     //每个工作线程一个，下标和任务队列一致，
+    bool m_persistent = true;     //构造时读取iomanager.epoll.persistent，之后不能改，
+    std::vector<Ring*> m_rings;   //为空表示用epoll，
 
 
     std::atomic<size_t> m_pendingEventCount = {0};
-    RWMutexType m_mutex;
-    std::vector<FdContext*> m_fdContexts;
+    //查找不加锁，扩容不阻塞读，FdContext创建后直到IOManager析构都不会释放，
+    SegmentedTable<std::atomic<FdContext*> > m_fdContexts;
 };  
 
 
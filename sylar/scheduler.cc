@@ -1,14 +1,49 @@
 #include "scheduler.h"
 #include "log.h"
 #include "macro.h"
+#include "config.h"
+#include "util.h"
+#include <sstream>
 
 
 namespace sylar {
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+//工作线程绑定的cpu列表，第i个线程绑定到第(i % size)个cpu上，为空表示不绑定，
+//use_caller的线程是调用者自己的线程，不绑定，
+static sylar::ConfigVar<std::vector<int> >::ptr g_scheduler_cpu_affinity =
+    sylar::Config::Lookup("scheduler.cpu_affinity", std::vector<int>(), "scheduler worker cpu list");
+
+//是否统计任务的排队时间和执行时间，每个任务多两三次clock_gettime，
+static sylar::ConfigVar<bool>::ptr g_scheduler_stats_enable =
+    sylar::Config::Lookup<bool>("scheduler.stats.enable", true, "scheduler task latency stats");
+
+static std::atomic<bool> s_stats_enable {true};
+
+namespace {
+struct _SchedulerIniter {
+    _SchedulerIniter() {
+        s_stats_enable.store(g_scheduler_stats_enable->getValue(), std::memory_order_relaxed);
+        g_scheduler_stats_enable->addListener([](const bool& old_value, const bool& new_value){
+            SYLAR_LOG_INFO(g_logger) << "scheduler stats enable changed from "
+                << old_value << " to " << new_value;
+            s_stats_enable.store(new_value, std::memory_order_relaxed);
+        });
+    }
+};
+static _SchedulerIniter s_scheduler_initer;
+}
+
 static thread_local Scheduler* t_scheduler = nullptr;
 static thread_local Fiber* t_scheduler_fiber = nullptr;
+//当前线程在所属scheduler中的任务队列下标，
+static thread_local int t_queue_index = -1;
+//run正在执行的任务协程，
+static thread_local Fiber* t_task_fiber = nullptr;
+//Park之后，协程切回调度协程时要调用的解锁函数，
+static thread_local void (*t_park_unlock)(void*) = nullptr;
+static thread_local void* t_park_arg = nullptr;
 
 Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name)
         :m_name(name){
@@ -25,16 +60,30 @@ Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name)
         sylar::Thread::SetName(m_name);
 
         t_scheduler_fiber = m_rootFiber.get();
+        t_queue_index = 0;
         m_rootThread = sylar::GetThreadId();
         m_threadIds.push_back(m_rootThread);
     } else {
         m_rootThread = -1;
     }
     m_threadCount = threads;
+
+    //队列下标和m_threadIds的下标一一对应，
+    size_t queues = threads + (use_caller ? 1 : 0);
+    for(size_t i = 0; i < queues; ++i){
+        m_queues.push_back(new WorkQueue());
+    }
+    if(use_caller){
+        m_queues[0]->thread_id = m_rootThread;
+    }
 }
 
 Scheduler::~Scheduler(){
     SYLAR_ASSERT(m_stopping);
+    for(auto& i : m_queues){
+        delete i;
+    }
+    m_queues.clear();
     if(GetThis()){
         t_scheduler = nullptr;
     }
@@ -49,6 +98,17 @@ Fiber* Scheduler::GetMainFiber(){
     return t_scheduler_fiber;
 }
 
+bool Scheduler::InTask(){
+    return t_task_fiber && t_task_fiber == Fiber::GetThis().get();
+}
+
+void Scheduler::Park(void (*unlock)(void*), void* arg){
+    SYLAR_ASSERT(InTask());
+    t_park_unlock = unlock;
+    t_park_arg = arg;
+    Fiber::YieldToHold();
+}
+
 //启动协程调度器，
 void Scheduler::start(){
     MutexType::Lock lock(m_mutex);
@@ -58,11 +118,17 @@ void Scheduler::start(){
     m_stopping = false;
     SYLAR_ASSERT(m_threads.empty());
     
+    m_cpuAffinity = g_scheduler_cpu_affinity->getValue();
     m_threads.resize(m_threadCount);   //扩容
     //创建剩下的线程，
+    int offset = m_rootThread == -1 ? 0 : 1;
     for(size_t i = 0; i < m_threadCount; i++){
-        m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this),
-                            m_name + "_"+ std::to_string(i)));
+        int idx = i + offset;
+        m_threads[i].reset(new Thread([this, idx](){
+                                t_queue_index = idx;
+                                run();
+                            }, m_name + "_"+ std::to_string(i)));
+        m_queues[idx]->thread_id = m_threads[i]->getId();
         m_threadIds.push_back(m_threads[i]->getId());
     }
     lock.unlock();
@@ -143,61 +209,71 @@ void Scheduler::run(){
     if(sylar::GetThreadId() != m_rootThread){
         t_scheduler_fiber = Fiber::GetThis().get();
     }
+    placeWorker(t_queue_index);
 
     Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this))); //bind绑定函数，第一个参数是函数指针，后面的参数是函数的形参，如果绑定的是成员函数，那么需要将对象指针传入
     Fiber::ptr cb_fiber;
 
+    //本线程的统计，只有本线程写，
+    WorkQueue* self = (t_queue_index >= 0 && t_queue_index < (int)m_queues.size())
+                        ? m_queues[t_queue_index] : nullptr;
+    uint64_t run_start = 0;
+
     FiberAndThread ft;
     while(true){
+        if(t_park_unlock){      //Park的协程已经切出来并且是HOLD状态了，现在才允许唤醒方调度它，
+            void (*unlock)(void*) = t_park_unlock;
+            t_park_unlock = nullptr;
+            unlock(t_park_arg);
+        }
+        onTaskSwitched();
         ft.reset();
         bool tickle_me = false;
-        bool is_active = false;
-        //下面大括号中的内容是，在m_fibers这个消息队列中取出一个带处理的消息给ft持有，
-        {
-            MutexType::Lock lock(m_mutex);
-            auto it = m_fibers.begin();
-            while(it != m_fibers.end()){
-                if(it->thread !=-1 && it->thread != sylar::GetThreadId()){      //不是本线程的fiber任务，就跳过，
-                    ++it;
-                    tickle_me = true;
-                    continue;
-                }
-
-                SYLAR_ASSERT(it->fiber || it->cb);
-                if(it ->fiber && it->fiber->getState() == Fiber::EXEC){
-                    ++it;
-                    continue;
-                }
-            ft = *it;
-            m_fibers.erase(it);
+        bool is_active = dequeue(ft, tickle_me);
+        if(is_active){
             ++m_activeThreadCount;
-            is_active = true;
-            break;
-            }
+        }
+        if(tickle_me){
+            tickle();
         }
 
+        run_start = 0;
+        if(self && ft.enqueue_ns && (ft.fiber || ft.cb)){
+            run_start = StatsNow();
+            if(run_start){
+                self->wait.record(run_start > ft.enqueue_ns ? run_start - ft.enqueue_ns : 0);
+            }
+        }
 
         if(ft.fiber && ft.fiber->getState() != Fiber::TERM
-                    || ft.fiber->getState() != Fiber::EXCEPT){
+                    && ft.fiber->getState() != Fiber::EXCEPT){
+            t_task_fiber = ft.fiber.get();
             ft.fiber->swapIn();
+            t_task_fiber = nullptr;
             --m_activeThreadCount;
+            recordRun(self, run_start);
 
             if(ft.fiber->getState() == Fiber::READY){
                 schedule(ft.fiber);
             } else if(ft.fiber->getState() != Fiber::TERM
-                    && ft.fiber->getState() != Fiber::EXEC){
+                    && ft.fiber->getState() != Fiber::EXCEPT){
                 ft.fiber->m_state = Fiber::HOLD;
+            } else {
+                Fiber::Recycle(ft.fiber);   //执行完了，放回空闲链表给后面的回调任务复用，
             }
             ft.reset();
         } else if(ft.cb){
             if(cb_fiber) {
-                cb_fiber->reset(ft.cb);
+                cb_fiber->reset(std::move(ft.cb));
             } else {
-                cb_fiber.reset(new Fiber(ft.cb));  //这里的reset是shared_ptr的函数，
+                cb_fiber = Fiber::Create(std::move(ft.cb));  //优先复用执行结束的协程，
             }
             ft.reset();
+            t_task_fiber = cb_fiber.get();
             cb_fiber->swapIn();
+            t_task_fiber = nullptr;
             --m_activeThreadCount;
+            recordRun(self, run_start);
 
             if(cb_fiber->getState() == Fiber::READY) {
                 schedule(cb_fiber);
@@ -218,24 +294,317 @@ void Scheduler::run(){
                 SYLAR_LOG_INFO(g_logger) << "idle fiber term";
                 break;
             }
+            if(self){
+                ++self->idles;
+                self->idle = true;
+            }
             ++m_idLeThreadCount;
             idle_fiber->swapIn();
             --m_idLeThreadCount;
+            if(self){
+                self->idle = false;
+            }
             if(idle_fiber->getState() != Fiber::TERM
-                    || idle_fiber->getState() != Fiber::EXCEPT) {
+                    && idle_fiber->getState() != Fiber::EXCEPT) {
                 idle_fiber->m_state = Fiber::HOLD;
             }
         }
     }
 }
 
+uint64_t Scheduler::StatsNow(){
+    return s_stats_enable.load(std::memory_order_relaxed) ? GetCurrentNS() : 0;
+}
+
+void Scheduler::recordRun(WorkQueue* self, uint64_t run_start){
+    if(!self){
+        return;
+    }
+    ++self->executed;
+    if(run_start){
+        uint64_t now = GetCurrentNS();
+        self->run.record(now > run_start ? now - run_start : 0);
+    }
+}
+
+void Scheduler::getStats(Stats& stats, int worker){
+    for(size_t i = 0; i < m_queues.size(); ++i){
+        if(worker != -1 && worker != (int)i){
+            continue;
+        }
+        WorkQueue* queue = m_queues[i];
+        stats.tasks += queue->executed;
+        stats.steals += queue->steals;
+        stats.idles += queue->idles;
+        stats.queued += queue->size;
+        stats.wait.merge(queue->wait);
+        stats.run.merge(queue->run);
+    }
+}
+
+void Scheduler::resetStats(){
+    //和工作线程的写并发，可能丢掉几个刚好在写的值，统计用不影响，
+    for(auto& i : m_queues){
+        i->executed = 0;
+        i->steals = 0;
+        i->idles = 0;
+        i->wait.reset();
+        i->run.reset();
+    }
+}
+
+std::ostream& Scheduler::Stats::dump(std::ostream& os) const{
+    os << "tasks=" << tasks
+       << " steals=" << steals
+       << " idles=" << idles
+       << " queued=" << queued << std::endl;
+    os << "    wait_ns: ";
+    wait.dump(os) << std::endl;
+    os << "    run_ns: ";
+    run.dump(os) << std::endl;
+    return os;
+}
+
+std::string Scheduler::Stats::toJson() const{
+    std::stringstream ss;
+    ss << "{\"tasks\":" << tasks
+       << ",\"steals\":" << steals
+       << ",\"idles\":" << idles
+       << ",\"queued\":" << queued
+       << ",\"wait_ns\":" << wait.toJson()
+       << ",\"run_ns\":" << run.toJson()
+       << "}";
+    return ss.str();
+}
+
+void Scheduler::placeWorker(int idx){
+    if(idx < 0 || idx >= (int)m_queues.size()){
+        return;
+    }
+    WorkQueue* queue = m_queues[idx];
+    if(!m_cpuAffinity.empty() && sylar::GetThreadId() != m_rootThread){
+        //use_caller时队列0是调用者线程，不绑定，第i个创建的工作线程用cpu_affinity[i % size]，
+        int worker = m_rootThread == -1 ? idx : idx - 1;
+        int cpu = m_cpuAffinity[worker % m_cpuAffinity.size()];
+        if(SetThreadAffinity(cpu)){
+            queue->cpu = cpu;
+        }
+    }
+    queue->node = GetNumaNode();
+    SYLAR_LOG_INFO(g_logger) << m_name << " worker " << idx
+        << " cpu=" << queue->cpu << " node=" << queue->node;
+}
+
+std::ostream& Scheduler::dump(std::ostream& os){
+    MutexType::Lock lock(m_mutex);
+    os << "[Scheduler name=" << m_name
+       << " size=" << m_threadCount
+       << " active_count=" << m_activeThreadCount
+       << " idle_count=" << m_idLeThreadCount
+       << " task_count=" << m_taskCount
+       << " stopping=" << m_stopping
+       << " ]" << std::endl;
+    for(size_t i = 0; i < m_queues.size(); ++i){
+        WorkQueue* queue = m_queues[i];
+        os << "    worker[" << i << "]"
+           << " thread=" << queue->thread_id
+           << " cpu=" << queue->cpu
+           << " node=" << queue->node
+           << " queue_size=" << queue->size
+           << std::endl;
+    }
+    return os;
+}
+
+int Scheduler::getWorkerIndex() const {
+    return GetThis() == this ? t_queue_index : -1;
+}
+
+//找不到时(线程刚创建还没写入id)任务会被放到别的队列，指定的线程偷任务时仍然能取到它，
+int Scheduler::getQueueIndex(int thread) const {
+    for(size_t i = 0; i < m_queues.size(); ++i){
+        if(m_queues[i]->thread_id == thread){
+            return i;
+        }
+    }
+    return -1;
+}
+
+int Scheduler::pickQueue(int thread){
+    int idx = -1;
+    if(thread != -1){
+        idx = getQueueIndex(thread);   //指定了线程的任务，只能放到该线程的队列中，
+    } else if(GetThis() == this){
+        idx = t_queue_index;           //本调度器的工作线程，放到自己的队列中，
+    }
+    if(idx < 0 || idx >= (int)m_queues.size()){
+        idx = m_nextQueue++ % m_queues.size();  //外部线程调度的任务，轮流放到各个队列中，
+    }
+    return idx;
+}
+
+bool Scheduler::enqueue(FiberAndThread& ft){
+    WorkQueue* queue = m_queues[pickQueue(ft.thread)];
+    bool need_tickle = false;
+    ft.enqueue_ns = StatsNow();
+    {
+        WorkQueue::MutexType::Lock lock(queue->mutex);
+        need_tickle = queue->tasks.empty();
+        queue->tasks.push_back(FiberAndThread());
+        queue->tasks.back().swap(ft);
+        ++queue->size;
+    }
+    ++m_taskCount;
+    return need_tickle;
+}
+
+void Scheduler::scheduleBatch(std::vector<FiberAndThread>& tasks){
+    if(tasks.empty()){
+        return;
+    }
+    WorkQueue* queue = m_queues[pickQueue(-1)];
+    bool need_tickle = false;
+    bool has_pinned = false;
+    size_t count = 0;
+    uint64_t now = StatsNow();
+    {
+        WorkQueue::MutexType::Lock lock(queue->mutex);
+        need_tickle = queue->tasks.empty();
+        for(auto& i : tasks){
+            if(i.thread != -1){
+                has_pinned = true;
+                continue;
+            }
+            if(!i.fiber && !i.cb){
+                continue;
+            }
+            queue->tasks.push_back(FiberAndThread());
+            queue->tasks.back().swap(i);
+            queue->tasks.back().enqueue_ns = now;
+            ++count;
+        }
+        queue->size += count;
+    }
+    m_taskCount += count;
+    need_tickle = need_tickle && count;
+
+    if(has_pinned){    //指定了线程的任务很少，单独放到各自线程的队列，
+        for(auto& i : tasks){
+            if(i.thread != -1 && (i.fiber || i.cb)){
+                need_tickle = enqueue(i) || need_tickle;
+            }
+        }
+    }
+    if(need_tickle){
+        tickle();
+    }
+}
+
+bool Scheduler::takeFrom(WorkQueue* queue, FiberAndThread& ft, bool steal, bool& tickle_me){
+    if(queue->size == 0){
+        return false;
+    }
+    WorkQueue::MutexType::Lock lock(queue->mutex);
+    if(queue->tasks.empty()){
+        return false;
+    }
+    //本线程从尾部取，偷的时候从头部取，
+    size_t n = queue->tasks.size();
+    for(size_t i = 0; i < n; ++i){
+        auto it = steal ? queue->tasks.begin() + i
+                        : queue->tasks.begin() + (n - 1 - i);
+        if(it->thread != -1 && it->thread != sylar::GetThreadId()){      //不是本线程的fiber任务，就跳过，
+            continue;
+        }
+
+        SYLAR_ASSERT(it->fiber || it->cb);
+        if(it->fiber && it->fiber->getState() == Fiber::EXEC){   //协程还没有swapOut，等一会再执行，
+            tickle_me = true;
+            continue;
+        }
+        ft.swap(*it);
+        queue->tasks.erase(it);
+        --queue->size;
+        --m_taskCount;
+        return true;
+    }
+    return false;
+}
+
+bool Scheduler::hasRunnableTask() const{
+    return findTask(true);
+}
+
+bool Scheduler::hasTaskForIdleWorkers() const{
+    return findTask(false);
+}
+
+bool Scheduler::findTask(bool for_me) const{
+    if(m_taskCount == 0){
+        return false;
+    }
+    int self = sylar::GetThreadId();
+    for(auto& queue : m_queues){
+        if(queue->size == 0){
+            continue;
+        }
+        WorkQueue::MutexType::Lock lock(queue->mutex);
+        for(auto& i : queue->tasks){
+            if(i.fiber && i.fiber->getState() == Fiber::EXEC){
+                continue;
+            }
+            if(i.thread == -1){
+                return true;
+            }
+            if(for_me){
+                if(i.thread == self){
+                    return true;
+                }
+            } else if(i.thread != self){
+                int idx = getQueueIndex(i.thread);
+                if(idx >= 0 && m_queues[idx]->idle){
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+bool Scheduler::dequeue(FiberAndThread& ft, bool& tickle_me){
+    if(m_taskCount == 0){
+        return false;
+    }
+    int idx = t_queue_index;
+    if(idx >= 0 && idx < (int)m_queues.size()
+            && takeFrom(m_queues[idx], ft, false, tickle_me)){
+        return true;
+    }
+    //自己的队列空了，去其他线程的队列偷任务，
+    size_t n = m_queues.size();
+    size_t start = idx < 0 ? 0 : idx + 1;
+    for(size_t i = 0; i < n; ++i){
+        size_t victim = (start + i) % n;
+        if((int)victim == idx){
+            continue;
+        }
+        bool skipped = false;
+        if(takeFrom(m_queues[victim], ft, true, skipped)){
+            if(idx >= 0 && idx < (int)m_queues.size()){
+                ++m_queues[idx]->steals;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
 void Scheduler::tickle(){
     SYLAR_LOG_INFO(g_logger) << "tickle";
 }
 
 bool Scheduler::stopping(){
-    MutexType::Lock lock(m_mutex);   //因为m_fibers是list数据结构，需要加锁，
-    return stopping && m_autoStop && m_fibers.empty()
+    return m_stopping && m_autoStop && m_taskCount == 0
                     && m_activeThreadCount == 0;
 }
 
@@ -4,9 +4,14 @@
 #include <memory>
 #include <string>
 #include <list>
+#include <deque>
+#include <atomic>
 #include <vector>
+#include <ostream>
 #include "thread.h"
 #include "fiber.h"
+#include "task.h"
+#include "histogram.h"
 #include "hook.h"
 
 namespace sylar {
@@ -26,35 +31,73 @@ public:
     static Scheduler* GetThis();
     static Fiber* GetMainFiber();
 
+    //当前是否在调度器执行的任务协程里，只有这时才能Park，
+    static bool InTask();
+    //挂起当前协程(HOLD)，等它真正切回调度协程之后才调用unlock(arg)，
+    //唤醒方要拿到同一把锁才能schedule这个协程，这样协程不会在切出去之前就被其他线程执行，
+    static void Park(void (*unlock)(void*), void* arg);
+
     void start();
     void stop();
 
-    //schedule这个函数的作用就是加入一个任务到 m_threads中，
+    //输出调度器状态，包括每个工作线程绑定的cpu、numa节点和队列长度，
+    std::ostream& dump(std::ostream& os);
+
+    //调度统计，每个工作线程各自记录，读的时候合并，
+    struct Stats {
+        uint64_t tasks = 0;     //执行的任务次数(协程每次swapIn算一次)
+        uint64_t steals = 0;    //从其他线程的队列偷到的任务数
+        uint64_t idles = 0;     //进入idle的次数
+        uint64_t queued = 0;    //当前排队的任务数
+        Histogram wait;         //任务从入队到开始执行的时间，纳秒
+        Histogram run;          //任务每次执行的时间(swapIn到切回来)，纳秒
+
+        std::ostream& dump(std::ostream& os) const;
+        std::string toJson() const;
+    };
+    //worker == -1时合并所有工作线程，否则只取下标为worker的线程，
+    void getStats(Stats& stats, int worker = -1);
+    //清空所有工作线程的统计，
+    void resetStats();
+
+    //schedule这个函数的作用就是加入一个任务到任务队列中，
+    //thread != -1 时任务只会被thread对应的线程执行，
     template<class FiberOrCb>
     void schedule(FiberOrCb fc, int thread = -1){
-        bool need_tickle = false;
-        {
-            MutexType::Lock lock(m_mutex);
-            need_tickle = scheduleNoLock(fc, thread);
-        }
-        if(need_tickle){
-            tickle();  //这个tickle函数，如果m_threads中有任务，就会通知任务去执行，
+        FiberAndThread ft(std::move(fc), thread);
+        if((ft.fiber || ft.cb) && enqueue(ft)){
+            tickle();  //这个tickle函数，如果有任务，就会通知空闲线程去执行，
         }
     }
 
 
-    //调度协程
+    //批量调度，[begin, end)里的Fiber::ptr/Task/std::function会被move走(调用后为空)，
+    //所有任务在一次加锁内放进同一个队列，最后只tickle一次，
     template<class InputIterator>
     void schedule(InputIterator begin, InputIterator end){
+        if(begin == end){
+            return;
+        }
+        WorkQueue* queue = m_queues[pickQueue(-1)];
         bool need_tickle = false;
+        size_t count = 0;
         {
-            MutexType::Lock lock(m_mutes);
-            while(begin != end){
-                need_tickle = scheduleNoLock(&begin, -1) || need_tickle;
-                ++begin;
+            uint64_t now = StatsNow();
+            WorkQueue::MutexType::Lock lock(queue->mutex);
+            need_tickle = queue->tasks.empty();
+            for(; begin != end; ++begin){
+                queue->tasks.emplace_back(&*begin, -1);
+                queue->tasks.back().enqueue_ns = now;
+                if(!queue->tasks.back().fiber && !queue->tasks.back().cb){
+                    queue->tasks.pop_back();
+                    continue;
+                }
+                ++count;
             }
+            queue->size += count;
         }
-        if(need_tickle){
+        m_taskCount += count;
+        if(need_tickle && count){
             tickle();
         }
     }
@@ -67,25 +110,24 @@ protected:
     virtual bool stopping();
     void setThis();
     virtual void idle();
-private:
-    template<class FiberOrCb>
-    bool scheduleNoLock(FiberOrCb fc, int thread){
-        bool need_tickle = m_fibers.empty();
-        FiberAndThread ft(fc, thread);
-        if(ft.fiber || ft.cb){
-            m_fibers.push_back(ft);    //加入一个任务，
-        }
-        return need_tickle;
-    }
-
-private:
+    //当前线程能不能取到任务：没有指定线程或者指定了本线程的任务，还在执行(EXEC)没切出去的协程不算，
+    //指定了其他线程的任务不算，否则空闲线程会一直空转等别的线程取走它，
+    bool hasRunnableTask() const;
+    //是否有任务需要唤醒其他空闲线程来执行：没有指定线程的任务，或者指定的线程正在idle，
+    bool hasTaskForIdleWorkers() const;
+    //当前线程在本调度器中的下标，不是本调度器的工作线程返回-1
+    int getWorkerIndex() const;
+    //每次从任务返回到调度协程之后调用(让出的协程已经是HOLD状态)，子类可以在这里提交攒下的请求，
+    virtual void onTaskSwitched() {}
+protected:
     struct FiberAndThread {
         Fiber::ptr fiber;
-        std::function<void()> cb;
+        Task cb;
         int thread;
+        uint64_t enqueue_ns = 0;    //入队时间，统计关闭时为0
 
         FiberAndThread(Fiber::ptr f, int thr)
-                :fiber(f), thread(thr){ 
+                :fiber(std::move(f)), thread(thr){ 
         }
 
         FiberAndThread(Fiber::ptr* f, int thr)
@@ -93,15 +135,20 @@ private:
             fiber.swap(*f);
         }
 
-        FiberAndThread(std::function<void()> f, int thr)
-                :cb(f), thread(thr){
+        FiberAndThread(Task f, int thr)
+                :cb(std::move(f)), thread(thr){
         }
 
-        FiberAndThread(std::function<void()>* f, int thr)
+        FiberAndThread(Task* f, int thr)
                 :thread(thr) {
             cb.swap(*f);
         }
 
+        FiberAndThread(std::function<void()>* f, int thr)
+                :cb(std::move(*f)), thread(thr) {
+            *f = nullptr;
+        }
+
         FiberAndThread()
                 :thread(-1){
         }
@@ -110,16 +157,70 @@ private:
             fiber = nullptr;
             cb = nullptr;
             thread = -1;
+            enqueue_ns = 0;
+        }
+
+        void swap(FiberAndThread& other){
+            fiber.swap(other.fiber);
+            cb.swap(other.cb);
+            std::swap(thread, other.thread);
+            std::swap(enqueue_ns, other.enqueue_ns);
         }
 
     };
 
+    //批量调度，tasks里的任务会被move走，未指定线程的任务一次加锁放进同一个队列，只tickle一次，
+    //IOManager用它把一次epoll_wait就绪的事件一起交给调度器，
+    void scheduleBatch(std::vector<FiberAndThread>& tasks);
+
+private:
+    //每个工作线程一个任务队列，本线程从尾部取(LIFO)，其他线程从头部偷(FIFO)
+    struct WorkQueue {
+        typedef Spinlock MutexType;
+        MutexType mutex;
+        std::deque<FiberAndThread> tasks;
+        std::atomic<size_t> size = {0};
+        //队列所属的线程id，线程创建后马上写入，还没写入时为-1，
+        //工作线程可能在start还没创建完所有线程时就开始调度，查找队列只读这里，不读m_threadIds，
+        std::atomic<int> thread_id = {-1};
+        std::atomic<bool> idle = {false};   //所属线程是否在idle里(空转或者阻塞)，
+        //队列所属工作线程的位置，线程开始run的时候记录，
+        int cpu = -1;
+        std::atomic<int> node = {-1};
+        //只有所属的工作线程写，
+        std::atomic<uint64_t> executed = {0};
+        std::atomic<uint64_t> steals = {0};
+        std::atomic<uint64_t> idles = {0};
+        Histogram wait;
+        Histogram run;
+    };
 
+    //scheduler.stats.enable打开时返回单调时钟(纳秒)，否则返回0，
+    static uint64_t StatsNow();
+    //记录一次任务执行，run_start为0时只计数，
+    void recordRun(WorkQueue* self, uint64_t run_start);
+
+    //加入一个任务到对应线程的队列中，返回是否需要tickle
+    bool enqueue(FiberAndThread& ft);
+    //从本线程的队列中取任务，取不到就去其他线程的队列偷，
+    bool dequeue(FiberAndThread& ft, bool& tickle_me);
+    bool takeFrom(WorkQueue* queue, FiberAndThread& ft, bool steal, bool& tickle_me);
+    //在所有队列里找一个可以马上执行的任务，for_me为true时找当前线程能执行的，否则找需要其他空闲线程执行的，
+    bool findTask(bool for_me) const;
+    //thread id对应的队列下标，-1表示没有找到
+    int getQueueIndex(int thread) const;
+    //任务应该放进哪个队列，
+    int pickQueue(int thread);
+    //按scheduler.cpu_affinity绑定当前工作线程，并记录所在的numa节点，
+    void placeWorker(int idx);
 
 private:
     MutexType m_mutex;
     std::vector<sylar::Thread::ptr> m_threads;
-    std::list<FiberAndThread> m_fibers;
+    std::vector<WorkQueue*> m_queues;
+    std::vector<int> m_cpuAffinity;    //start时从配置读取，
+    std::atomic<size_t> m_taskCount = {0};
+    std::atomic<size_t> m_nextQueue = {0};
     std::string m_name;
     Fiber::ptr m_rootFiber;
 protected:
@@ -0,0 +1,84 @@
+#ifndef __SYLAR_SEGMENTED_TABLE_H__
+#define __SYLAR_SEGMENTED_TABLE_H__
+
+#include <stddef.h>
+#include <atomic>
+#include "noncopyable.h"
+
+namespace sylar {
+
+//按下标(fd)存放的分段表，只增不减，
+//段指针是原子的，查找不加锁；扩容只是分配一个新段再CAS发布，已经发布的段不会移动，
+//所以扩容不会阻塞读，槽的地址一旦分配就一直有效，槽里的内容由使用者自己保证线程安全，
+template<class T, int SEGMENT_BITS = 12, int MAX_SEGMENTS = 256>
+class SegmentedTable : public Noncopyable {
+public:
+    static const size_t SEGMENT_SIZE = (size_t)1 << SEGMENT_BITS;
+    static const size_t CAPACITY = SEGMENT_SIZE * MAX_SEGMENTS;
+
+    SegmentedTable() {
+        for(int i = 0; i < MAX_SEGMENTS; ++i) {
+            m_segments[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~SegmentedTable() {
+        for(int i = 0; i < MAX_SEGMENTS; ++i) {
+            Segment* seg = m_segments[i].load(std::memory_order_relaxed);
+            if(seg) {
+                delete seg;
+            }
+        }
+    }
+
+    //idx对应的槽，段还没有分配并且create为false时返回nullptr，超出容量也返回nullptr，
+    T* at(size_t idx, bool create = false) {
+        if(idx >= CAPACITY) {
+            return nullptr;
+        }
+        std::atomic<Segment*>& slot = m_segments[idx >> SEGMENT_BITS];
+        Segment* seg = slot.load(std::memory_order_acquire);
+        if(!seg) {
+            if(!create) {
+                return nullptr;
+            }
+            Segment* expected = nullptr;
+            seg = new Segment();
+            if(!slot.compare_exchange_strong(expected, seg
+                        ,std::memory_order_acq_rel, std::memory_order_acquire)) {
+                delete seg;        //其他线程先分配了，用它的，
+                seg = expected;
+            }
+        }
+        return &seg->items[idx & (SEGMENT_SIZE - 1)];
+    }
+
+    //遍历所有已经分配的槽，fn(size_t idx, T& item)
+    template<class Fn>
+    void foreach(Fn fn) {
+        for(int i = 0; i < MAX_SEGMENTS; ++i) {
+            Segment* seg = m_segments[i].load(std::memory_order_acquire);
+            if(!seg) {
+                continue;
+            }
+            for(size_t j = 0; j < SEGMENT_SIZE; ++j) {
+                fn((size_t)i * SEGMENT_SIZE + j, seg->items[j]);
+            }
+        }
+    }
+
+private:
+    struct Segment {
+        T items[SEGMENT_SIZE];
+
+        Segment()
+            :items() {
+        }
+    };
+
+    std::atomic<Segment*> m_segments[MAX_SEGMENTS];
+};
+
+}
+
+#endif
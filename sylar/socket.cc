@@ -129,6 +129,49 @@ Socket::ptr Socket::accept() {
     return nullptr;
 }
 
+size_t Socket::acceptBatch(std::vector<Socket::ptr>& clients, size_t max) {
+    size_t count = 0;
+    while(count < max) {
+        sockaddr_storage addr;
+        socklen_t addrlen = sizeof(addr);
+        int newsock = -1;
+        if(count == 0) {    //没有连接时挂起当前协程，不能用hook过的accept4(SOCK_NONBLOCK)，它会把fd标记为用户非阻塞，
+            newsock = accept_nonblock(m_sock, (sockaddr*)&addr, &addrlen);
+        } else {            //已经取到连接了，backlog空了就返回，不再等待，
+            newsock = accept4_f(m_sock, (sockaddr*)&addr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if(newsock >= 0) {
+                FdMgr::GetInstance()->create(newsock, true);
+            }
+        }
+        if(newsock == -1) {
+            if(count == 0 || (errno != EAGAIN && errno != EINTR)) {
+                SYLAR_LOG_ERROR(g_logger) << "accept4(" << m_sock << ") errno="
+                    << errno << " errstr=" << strerror(errno);
+            }
+            break;
+        }
+        Socket::ptr sock(new Socket(m_family, m_type, m_protocol));
+        sock->initAccepted(newsock, (sockaddr*)&addr, addrlen);
+        clients.push_back(sock);
+        ++count;
+    }
+    return count;
+}
+
+//accept4已经给出了对端地址，fd也已经在FdMgr里登记成非阻塞socket，
+//省掉init里的fstat、SO_REUSEADDR、getsockname和getpeername，本地地址用到时再取，
+void Socket::initAccepted(int sock, const sockaddr* addr, socklen_t addrlen) {
+    m_sock = sock;
+    m_isConnected = true;
+    if(m_type == SOCK_STREAM) {
+        int val = 1;
+        setOption(IPPROTO_TCP, TCP_NODELAY, val);
+    }
+    if(m_family == AF_INET || m_family == AF_INET6) {
+        m_remoteAddress = Address::Create(addr, addrlen);
+    }
+}
+
 //用于初始化一个客户端的socket对象，
 bool Socket::init(int sock) {
     FdCtx::ptr ctx = FdMgr::GetInstance()->get(sock);
@@ -152,6 +195,17 @@ void Socket::initSock() {
 }
 
 
+bool Socket::setReusePort(bool v) {
+    if(!isValid()) {
+        newSock();
+        if(!isValid()) {
+            return false;
+        }
+    }
+    int val = v ? 1 : 0;
+    return setOption(SOL_SOCKET, SO_REUSEPORT, val);
+}
+
 bool Socket::bind(const Address::ptr addr) {
     if(SYLAR_UNLICKLY(!isValid())) {
         newSock();  //初始化m_sock   m_sock是服务端的套接子，
@@ -405,7 +459,7 @@ std::ostream& Socket::dump(std::ostream& os) const {
        <<" family=" << m_family
        <<" type=" << m_type
        << "protocol=" << m_protocol;
-       if(m_remoteAddress) {
+       if(m_localAddress) {
             os << "local_address=" << m_localAddress->toString();
        }
        if(m_remoteAddress) {
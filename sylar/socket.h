@@ -60,6 +60,9 @@ public:
     }
 
     Socket::ptr accept();
+    //第一个连接按hook的方式等待，之后把backlog里已经完成握手的连接一次取完，最多max个，
+    //新连接用accept4(SOCK_NONBLOCK|SOCK_CLOEXEC)创建，返回取到的个数，
+    size_t acceptBatch(std::vector<Socket::ptr>& clients, size_t max);
 
     bool bind(const Address::ptr addr);
     bool connect(const Address::ptr addr, uint64_t timeout_ms = -1);
@@ -99,10 +102,14 @@ public:
 
     bool getisBind() { return isBind;}
 
+    //bind之前调用，多个socket可以监听同一个端口，由内核按连接分给它们，
+    bool setReusePort(bool v);
+
 private:
     void initSock();
     void newSock();
     bool init(int sock);
+    void initAccepted(int sock, const sockaddr* addr, socklen_t addrlen);
 private:
     int m_sock;
     int m_family;
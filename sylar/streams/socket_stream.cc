@@ -1,4 +1,5 @@
 #include "socket_stream.h"
+#include <limits.h>
 
 namespace sylar {
 
@@ -59,6 +60,35 @@ int SocketStream::write(ByteArray::ptr ba, size_t length) {
 
 
 }
+int SocketStream::writev(const iovec* iovs, size_t count) {
+    if(!isConnected()) {
+        return -1;
+    }
+    return m_socket->send(iovs, count);
+}
+
+int SocketStream::writevFixSize(iovec* iovs, size_t count) {
+    int64_t total = 0;
+    while(count > 0) {
+        int rt = writev(iovs, count > IOV_MAX ? IOV_MAX : count);
+        if(rt <= 0) {
+            return rt;
+        }
+        total += rt;
+        size_t left = rt;
+        while(count > 0 && left >= iovs->iov_len) {   //跳过已经写完的块，
+            left -= iovs->iov_len;
+            ++iovs;
+            --count;
+        }
+        if(left) {
+            iovs->iov_base = (char*)iovs->iov_base + left;
+            iovs->iov_len -= left;
+        }
+    }
+    return total;
+}
+
 void SocketStream::close() {
     if(!m_socket->isConnected()) {
         m_socket->close();
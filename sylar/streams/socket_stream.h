@@ -17,6 +17,10 @@ public:
 
     virtual int write(const void* buffer, size_t length) override;
     virtual int write(ByteArray::ptr ba, size_t length) override;
+    //一次系统调用写多块内存，
+    int writev(const iovec* iovs, size_t count);
+    //写完所有iovs为止，iovs会被修改，成功返回写的总字节数，
+    int writevFixSize(iovec* iovs, size_t count);
 
     bool isConnected() const;
     Socket::ptr getSocket() { return m_socket;}
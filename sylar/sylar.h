@@ -8,6 +8,8 @@
 #include "fiber.h"
 #include "thread.h"
 #include "scheduler.h"
+#include "fiber_sync.h"
+#include "channel.h"
 #include "unistd.h"
 #include "iomanager.h"
 
@@ -0,0 +1,236 @@
+#ifndef __SYLAR_TASK_H__
+#define __SYLAR_TASK_H__
+
+#include <stddef.h>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <functional>
+#include <type_traits>
+
+//调度器队列里的任务类型，用来代替std::function<void()>，
+//std::function只能内联两个指针大小的捕获，再大就要malloc，比如TcpServer里
+//std::bind(&TcpServer::handleClient, shared_from_this(), client)，
+//Task只能move不能拷贝，有64字节的内联缓冲区，放不下的才在堆上分配，
+namespace sylar {
+
+class Task {
+public:
+    //内联缓冲区大小，大于它(或者move可能抛异常)的可调用对象放在堆上，
+    static const size_t INLINE_SIZE = 64;
+
+private:
+    template<class F>
+    struct IsCallable {
+        template<class U>
+        static auto test(int) -> decltype(std::declval<U&>()(), std::true_type());
+        template<class U>
+        static std::false_type test(...);
+        static const bool value = decltype(test<F>(0))::value;
+    };
+
+    template<class F>
+    struct FitsInline {
+        static const bool value = sizeof(F) <= INLINE_SIZE
+                && alignof(F) <= alignof(std::max_align_t)
+                && std::is_nothrow_move_constructible<F>::value;
+    };
+
+public:
+    Task() {}
+
+    Task(std::nullptr_t) {}
+
+    //任意无参可调用对象，空的std::function/函数指针会得到空的Task，
+    template<class F, class D = typename std::decay<F>::type
+            ,class = typename std::enable_if<!std::is_same<D, Task>::value
+                    && IsCallable<D>::value>::type>
+    Task(F&& f) {
+        if(IsNull(f)) {
+            return;
+        }
+        init<D>(std::forward<F>(f), std::integral_constant<bool, FitsInline<D>::value>());
+    }
+
+    Task(Task&& other) {
+        moveFrom(other);
+    }
+
+    Task& operator=(Task&& other) {
+        if(this != &other) {
+            clear();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Task& operator=(std::nullptr_t) {
+        clear();
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        clear();
+    }
+
+    void operator()() {
+        m_ops->invoke(&m_buf);
+    }
+
+    explicit operator bool() const { return m_ops != nullptr;}
+
+    void swap(Task& other) {
+        Task tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+    //可调用对象是否放在内联缓冲区里，
+    bool isInline() const { return m_ops && m_ops->inline_storage;}
+
+    //循环定时器每次触发都需要一份任务，Task不能拷贝，
+    //第一次调用时把自己的可调用对象转移到一个共享的Task里，之后返回的Task都引用这一份，
+    Task share();
+
+    //可调用对象能拷贝时返回一份独立的拷贝(和拷贝std::function一样)，
+    //只能move的可调用对象没法拷贝，退化成share()，返回的Task共享同一份状态，
+    Task copy();
+
+private:
+    template<class F>
+    static bool IsNull(const F&) { return false;}
+    template<class R, class... Args>
+    static bool IsNull(const std::function<R(Args...)>& f) { return !f;}
+    template<class R, class... Args>
+    static bool IsNull(R (*f)(Args...)) { return f == nullptr;}
+
+    typedef void (*CloneFn)(const void* from, void* to);
+
+    //不同类型的可调用对象的操作表，每种类型一份静态的，
+    struct Ops {
+        void (*invoke)(void* buf);
+        void (*move)(void* from, void* to);   //move构造到to，并析构from
+        void (*destroy)(void* buf);
+        CloneFn clone;      //拷贝构造到to，不能拷贝的类型为nullptr，
+        bool inline_storage;
+    };
+
+    //和std::function一样按is_copy_constructible判断能不能拷贝，
+    template<class F, bool = std::is_copy_constructible<F>::value>
+    struct CloneOps {
+        static void Inline(const void* from, void* to) { new (to) F(*(const F*)from);}
+        static void Heap(const void* from, void* to) { *(F**)to = new F(**(F* const*)from);}
+        static CloneFn GetInline() { return &Inline;}
+        static CloneFn GetHeap() { return &Heap;}
+    };
+
+    template<class F>
+    struct CloneOps<F, false> {
+        static CloneFn GetInline() { return nullptr;}
+        static CloneFn GetHeap() { return nullptr;}
+    };
+
+    template<class F>
+    struct InlineOps {
+        static void Invoke(void* buf) { (*(F*)buf)();}
+        static void Move(void* from, void* to) {
+            new (to) F(std::move(*(F*)from));
+            ((F*)from)->~F();
+        }
+        static void Destroy(void* buf) { ((F*)buf)->~F();}
+        static const Ops* Get() {
+            static const Ops s_ops = {&Invoke, &Move, &Destroy, CloneOps<F>::GetInline(), true};
+            return &s_ops;
+        }
+    };
+
+    template<class F>
+    struct HeapOps {
+        static void Invoke(void* buf) { (**(F**)buf)();}
+        static void Move(void* from, void* to) {
+            *(F**)to = *(F**)from;
+            *(F**)from = nullptr;
+        }
+        static void Destroy(void* buf) { delete *(F**)buf;}
+        static const Ops* Get() {
+            static const Ops s_ops = {&Invoke, &Move, &Destroy, CloneOps<F>::GetHeap(), false};
+            return &s_ops;
+        }
+    };
+
+    template<class D, class F>
+    void init(F&& f, std::true_type) {
+        new (&m_buf) D(std::forward<F>(f));
+        m_ops = InlineOps<D>::Get();
+    }
+
+    template<class D, class F>
+    void init(F&& f, std::false_type) {
+        *(D**)&m_buf = new D(std::forward<F>(f));
+        m_ops = HeapOps<D>::Get();
+    }
+
+    void moveFrom(Task& other) {
+        if(other.m_ops) {
+            other.m_ops->move(&other.m_buf, &m_buf);
+            m_ops = other.m_ops;
+            other.m_ops = nullptr;
+        }
+    }
+
+    void clear() {
+        if(m_ops) {
+            const Ops* ops = m_ops;
+            m_ops = nullptr;
+            ops->destroy(&m_buf);
+        }
+    }
+
+private:
+    struct Shared;
+
+    typename std::aligned_storage<INLINE_SIZE, alignof(std::max_align_t)>::type m_buf;
+    const Ops* m_ops = nullptr;
+};
+
+struct Task::Shared {
+    std::shared_ptr<Task> task;
+
+    void operator()() {
+        (*task)();
+    }
+};
+
+inline Task Task::share() {
+    if(!m_ops) {
+        return Task();
+    }
+    if(m_ops != InlineOps<Shared>::Get()) {
+        std::shared_ptr<Task> task = std::make_shared<Task>(std::move(*this));
+        *this = Shared{task};
+    }
+    return Shared{((Shared*)&m_buf)->task};
+}
+
+inline Task Task::copy() {
+    if(!m_ops || !m_ops->clone) {
+        return share();
+    }
+    Task task;
+    m_ops->clone(&m_buf, &task.m_buf);
+    task.m_ops = m_ops;
+    return task;
+}
+
+inline bool operator==(const Task& task, std::nullptr_t) { return !task;}
+inline bool operator==(std::nullptr_t, const Task& task) { return !task;}
+inline bool operator!=(const Task& task, std::nullptr_t) { return (bool)task;}
+inline bool operator!=(std::nullptr_t, const Task& task) { return (bool)task;}
+
+}
+
+#endif
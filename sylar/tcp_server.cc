@@ -9,6 +9,14 @@ static sylar::ConfigVar<uint64_t>::ptr g_tcp_server_read_timeout =
     sylar::Config::Lookup("tcp_server.read_timeout", (uint64_t)(60 * 1000 * 2), 
         "tcp server read timeout");
 
+static sylar::ConfigVar<uint32_t>::ptr g_tcp_server_max_connections =
+    sylar::Config::Lookup("tcp_server.max_connections", (uint32_t)0,
+        "tcp server max concurrent connections, 0 means unlimited");
+
+static sylar::ConfigVar<uint32_t>::ptr g_tcp_server_accept_batch =
+    sylar::Config::Lookup("tcp_server.accept_batch", (uint32_t)64,
+        "tcp server max connections accepted per wakeup");
+
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
 TcpServer::TcpServer(sylar::IOManager* woker
@@ -17,6 +25,10 @@ TcpServer::TcpServer(sylar::IOManager* woker
         :m_worker(woker)
         ,m_acceptWorker(accept_worker)
         ,m_recvTimeout(g_tcp_server_read_timeout->getValue())
+        ,m_maxConnections(g_tcp_server_max_connections->getValue())
+        ,m_acceptBatch(g_tcp_server_accept_batch->getValue())
+        ,m_connections(0)
+        ,m_shedCount(0)
         ,m_name("sylar/1.0.0")
         ,m_isStop(true){
 }
@@ -39,27 +51,44 @@ bool TcpServer::bind(sylar::Address::ptr addr) {
 bool TcpServer::bind(const std::vector<sylar::Address::ptr>& addrs
                     , std::vector<sylar::Address::ptr>& fails) {
     for(auto& addr : addrs) {
-        sylar::Socket::ptr sock = Socket::CreateTCP(addr);
-        if(!sock->bind(addr)) {
-            SYLAR_LOG_ERROR(g_logger) << "bind fail errno="
-                        << errno << " errstr=" << strerror(errno)
-                        << " addr =[" << addr->toString() << "]";
-            fails.push_back(addr);
-            continue;
+        //多reactor模式下每个reactor一个监听socket，unix域socket不支持SO_REUSEPORT，只绑一次，
+        size_t copies = 1;
+        bool reuseport = !m_reactors.empty() && addr->getFamliy() != AF_UNIX;
+        if(reuseport) {
+            copies = m_reactors.size();
         }
-        if(!sock->listen()) {
-            SYLAR_LOG_ERROR(g_logger) << "listen fail errno = "
-                    << errno << "errstr= " << strerror(errno)
-                    << " addr=[" << addr->toString() << "]";
-            continue;
+        for(size_t i = 0; i < copies; ++i) {
+            sylar::Socket::ptr sock = Socket::CreateTCP(addr);
+            if(reuseport && !sock->setReusePort(true)) {
+                SYLAR_LOG_ERROR(g_logger) << "set SO_REUSEPORT fail errno="
+                            << errno << " errstr=" << strerror(errno)
+                            << " addr =[" << addr->toString() << "]";
+                fails.push_back(addr);
+                break;
+            }
+            if(!sock->bind(addr)) {
+                SYLAR_LOG_ERROR(g_logger) << "bind fail errno="
+                            << errno << " errstr=" << strerror(errno)
+                            << " addr =[" << addr->toString() << "]";
+                fails.push_back(addr);
+                break;
+            }
+            if(!sock->listen()) {
+                SYLAR_LOG_ERROR(g_logger) << "listen fail errno = "
+                        << errno << "errstr= " << strerror(errno)
+                        << " addr=[" << addr->toString() << "]";
+                continue;
+            }
+            m_socks.push_back(sock);
+            m_sockWorkers.push_back(m_reactors.empty() ? m_acceptWorker : m_reactors[i]);
         }
-        m_socks.push_back(sock);
     }
     if(!fails.empty()) {
         for(auto& i : m_socks) {
         i->close();
         }
         m_socks.clear();
+        m_sockWorkers.clear();
         return false;
     }
     for(auto& i : m_socks) {
@@ -73,9 +102,9 @@ bool TcpServer::start() {
         return true;
     }
     m_isStop = false;
-    for(auto& sock : m_socks) {
-        m_acceptWorker->schedule(std::bind(&TcpServer::startAccept,
-            shared_from_this(), sock));
+    for(size_t i = 0; i < m_socks.size(); ++i) {
+        m_sockWorkers[i]->schedule(std::bind(&TcpServer::startAccept,
+            shared_from_this(), m_socks[i]));
     }
     return true;
 }
@@ -83,28 +112,60 @@ bool TcpServer::start() {
 void TcpServer::stop() {
     m_isStop = true;
     auto self = shared_from_this();
-    m_acceptWorker->schedule([this, self](){
-        for(auto& sock : m_socks) {
+    if(m_reactors.empty()) {
+        m_acceptWorker->schedule([this, self](){
+            for(auto& sock : m_socks) {
+                sock->cancelAll();
+                sock->close();
+            }
+            m_socks.clear();
+            m_sockWorkers.clear();
+        });
+        return;
+    }
+    //监听socket的事件注册在各自reactor的epoll上，要回到那个reactor上取消，
+    for(size_t i = 0; i < m_socks.size(); ++i) {
+        Socket::ptr sock = m_socks[i];
+        m_sockWorkers[i]->schedule([self, sock](){
             sock->cancelAll();
             sock->close();
-        }
-        m_socks.clear();
-    });
+        });
+    }
+    m_socks.clear();
+    m_sockWorkers.clear();
 }
 
 void TcpServer::startAccept(Socket::ptr sock) {   //服务器开始接受请求，
+    std::vector<Socket::ptr> clients;
     while(!m_isStop) {  //这里循环，就可以不停的监听来请求的客户端，
-        Socket::ptr client = sock->accept();
-        if(client) {   //如果这里服务端接受了这个客户端，那么就通过携程去处理客户端的请求，
-            m_worker->schedule(std::bind(&TcpServer::handleClient, 
-                        shared_from_this(), client));
-        } else {
-            SYLAR_LOG_ERROR(g_logger) << "accept errno = " << errno
-                    << " errstr= " << strerror(errno);
+        clients.clear();
+        sock->acceptBatch(clients, m_acceptBatch ? m_acceptBatch : 1);   //失败时acceptBatch里已经打了日志，
+        for(auto& client : clients) {   //如果这里服务端接受了这个客户端，那么就通过携程去处理客户端的请求，
+            if(m_maxConnections && m_connections >= m_maxConnections) {
+                //过载了，新连接直接关掉，不让连接风暴拖慢已有的连接，
+                ++m_shedCount;
+                client->close();
+                continue;
+            }
+            ++m_connections;
+            if(m_reactors.empty()) {
+                m_worker->schedule(std::bind(&TcpServer::serveClient, 
+                            shared_from_this(), client));
+            } else {
+                //多reactor模式，连接留在accept它的线程上处理，
+                IOManager::GetThis()->schedule(std::bind(&TcpServer::serveClient,
+                            shared_from_this(), client), sylar::GetThreadId());
+            }
         }
+        //一批处理完让出，已有连接的协程先跑，
+        Fiber::YieldToReady();
     }
 }
 
+void TcpServer::serveClient(Socket::ptr client) {
+    handleClient(client);
+    --m_connections;
+}
 
 void TcpServer::handleClient(Socket::ptr client) {  //这个函数放到具体继承这个类的类实现，   handleClient函数主要用于处理服务器和客户端到底有什么交互，
     SYLAR_LOG_INFO(g_logger) << "handleClient:" << *client;
@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <functional>
+#include <atomic>
 #include "address.h"
 #include "iomanager.h"
 #include "socket.h"
@@ -27,16 +28,42 @@ public:
     void setReadTimeout(uint64_t v) {m_recvTimeout = v;}
     void setName(const std::string& v) { m_name = v;}
 
+    //同时处理的连接数上限，0表示不限制，超过上限时新连接accept之后直接关闭，
+    uint32_t getMaxConnections() const { return m_maxConnections;}
+    void setMaxConnections(uint32_t v) { m_maxConnections = v;}
+    //每次唤醒最多accept多少个连接，
+    uint32_t getAcceptBatch() const { return m_acceptBatch;}
+    void setAcceptBatch(uint32_t v) { m_acceptBatch = v ? v : 1;}
+
+    uint32_t getConnectionCount() const { return m_connections;}
+    //因为超过max_connections被关闭的连接数，
+    uint64_t getShedCount() const { return m_shedCount;}
+
     bool isStop() const { return m_isStop;}
 
+    //多reactor模式，bind之前调用，每个reactor(建议是单线程的IOManager)在同一个地址上
+    //各自有一个SO_REUSEPORT的监听socket，由内核把连接分给它们，
+    //连接在哪个reactor上accept就一直在哪个reactor上处理，不会跨线程，
+    void setReactors(const std::vector<IOManager*>& reactors) { m_reactors = reactors;}
+    const std::vector<IOManager*>& getReactors() const { return m_reactors;}
+
 protected:
     virtual void handleClient(Socket::ptr client);
     virtual void startAccept(Socket::ptr sock);
+private:
+    void serveClient(Socket::ptr client);
 private:
     std::vector<Socket::ptr> m_socks;
+    //和m_socks一一对应，监听socket在哪个IOManager上accept，
+    std::vector<IOManager*> m_sockWorkers;
+    std::vector<IOManager*> m_reactors;
     IOManager* m_worker;
     IOManager* m_acceptWorker;
     uint64_t m_recvTimeout;
+    uint32_t m_maxConnections;
+    uint32_t m_acceptBatch;
+    std::atomic<uint32_t> m_connections;
+    std::atomic<uint64_t> m_shedCount;
     std::string m_name;
     bool m_isStop;
 };
@@ -201,6 +201,11 @@ public:
         pthread_spin_lock(&m_mutex);
     }
 
+    //拿不到锁立即返回false，
+    bool trylock(){
+        return pthread_spin_trylock(&m_mutex) == 0;
+    }
+
     void unlock(){
         pthread_spin_unlock(&m_mutex);
     }
@@ -1,7 +1,47 @@
 #include "timer.h"
+#include "config.h"
+#include "log.h"
 
 namespace sylar {
 
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+//定时器的存储方式，set: 红黑树，O(log n)；wheel: 分层时间轮，插入删除O(1)
+static sylar::ConfigVar<std::string>::ptr g_timer_backend =
+    sylar::Config::Lookup<std::string>("timer.backend", "wheel", "timer backend, set or wheel");
+
+//条件定时器(超时)的到期时间向上取整到slack的整数倍，相同区间的定时器一起到期，合并成一个任务执行，0表示不合并
+static sylar::ConfigVar<uint32_t>::ptr g_timer_coalesce_slack_ms =
+    sylar::Config::Lookup<uint32_t>("timer.coalesce_slack_ms", 0, "timer coalesce slack in ms");
+
+static std::atomic<uint32_t> s_coalesce_slack_ms {0};
+
+namespace {
+struct _TimerIniter {
+    _TimerIniter() {
+        s_coalesce_slack_ms.store(g_timer_coalesce_slack_ms->getValue(), std::memory_order_relaxed);
+        g_timer_coalesce_slack_ms->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            SYLAR_LOG_INFO(g_logger) << "timer coalesce slack ms changed from "
+                << old_value << " to " << new_value;
+            s_coalesce_slack_ms.store(new_value, std::memory_order_relaxed);
+        });
+    }
+};
+
+static _TimerIniter s_timer_initer;
+}
+
+//同一批到期的合并定时器的回调，按顺序执行，
+struct CoalescedCb {
+    std::vector<Task> cbs;
+
+    void operator()() {
+        for(auto& cb : cbs) {
+            cb();
+        }
+    }
+};
+
 bool Timer::Comparator::operator() (const Timer::ptr& lhs, const Timer::ptr& rhs) const {
     if(!lhs && !rhs) {
         return false;
@@ -21,47 +61,52 @@ bool Timer::Comparator::operator() (const Timer::ptr& lhs, const Timer::ptr& rhs
     if(lhs->m_next > rhs->m_next) {
         return false;
     }
-    return lhs.get() <= rhs.get();
+    return lhs.get() < rhs.get();
 }
 
 
-Timer::Timer(uint64_t ms, std::function<void()> cb,
-            bool recurring, TimerManager* manager) 
+Timer::Timer(uint64_t ms, Task cb,
+            bool recurring, TimerManager* manager, uint32_t slack) 
     :m_ms(ms)
-    ,m_cb(cb)
+    ,m_cb(std::move(cb))
     ,m_recurring(recurring)
-    ,m_manager(manager){
-    m_next = sylar::GetCurrentMS() + m_ms;
+    ,m_manager(manager)
+    ,m_slack(slack) {
+    setNext(sylar::GetCurrentMS() + m_ms);
 }
 
 Timer::Timer(uint64_t next) 
     :m_next(next){
 }
 
+void Timer::setNext(uint64_t next) {
+    if(m_slack > 1) {
+        next = (next + m_slack - 1) / m_slack * m_slack;
+    }
+    m_next = next;
+}
+
 bool Timer::cancel() {
-    TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
-    if(m_cb) {
-        m_cb = nullptr;
-        auto it = m_manager->m_timers.find(shared_from_this());
-        m_manager->m_timers.erase(it);
-        return true;
+    int expected = ACTIVE;
+    if(!m_state.compare_exchange_strong(expected, CANCELLED)) {     //已经取消或者已经触发，
+        return false;
     }
-    return false;
+    m_manager->cancelTimer(this);
+    return true;
 }
 
 bool Timer::refresh() {
-    TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
-    if(!m_cb) {
+    TimerManager::Shard* shard = m_manager->m_shards[m_shard];
+    TimerManager::MutexType::Lock lock(shard->mutex);
+    if(m_state != ACTIVE) {
         return false;
     }
-    auto it = m_manager->m_timers.find(shared_from_this());
-    if(it == m_manager->m_timers.end()) {
+    Timer::ptr self = shared_from_this();
+    if(!m_manager->removeTimer(shard, self)) {     //先删除，从timers中，
         return false;
     }
-
-    m_manager->m_timers.erase(it);       //先删除，从timers中，
-    m_next = sylar::GetCurrentMS() + m_ms;
-    m_manager->m_timers.insert(shared_from_this()); //这里不是直接修改timers里面的timer的时间，而是先将其移除再插入，这样不会影响set数据结构，
+    setNext(sylar::GetCurrentMS() + m_ms);
+    m_manager->insertTimer(shard, self); //这里不是直接修改timers里面的timer的时间，而是先将其移除再插入，这样不会影响set数据结构，
     return true;
 }
 
@@ -70,16 +115,15 @@ bool Timer::reset(uint64_t ms, bool from_now) {
         return true;
     }
 
-    TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
-    if(!m_cb) {
+    TimerManager::Shard* shard = m_manager->m_shards[m_shard];
+    TimerManager::MutexType::Lock lock(shard->mutex);
+    if(m_state != ACTIVE) {
         return false;
     }
-    auto it = m_manager->m_timers.find(shared_from_this());
-    if(it == m_manager->m_timers.end()) {
+    if(!m_manager->removeTimer(shard, shared_from_this())) {
         return false;
     }
 
-    m_manager->m_timers.erase(it);
     uint64_t start = 0;
     if(from_now) {      //从现在开始，
         start = sylar::GetCurrentMS();
@@ -87,25 +131,329 @@ bool Timer::reset(uint64_t ms, bool from_now) {
         start = m_next - m_ms;     //上一次执行的时间，
     }
     m_ms = ms;
-    m_next = start + m_ms;
-    m_manager->addTimer(shared_from_this(),lock);
+    setNext(start + m_ms);
+    m_manager->addTimer(shard, shared_from_this(), lock);
     return true;
 }
 
-TimerManager::TimerManager() {
-    m_previousTimer = sylar::GetCurrentMS();
+TimerWheel::TimerWheel(uint64_t now_ms)
+    :m_current(now_ms) {
+    for(int i = 0; i < SLOTS; ++i) {
+        m_slots[i] = nullptr;
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    std::vector<Timer::ptr> timers;
+    clear(timers, m_current);
+}
+
+void TimerWheel::link(Timer* timer, int slot) {
+    timer->m_prev = nullptr;
+    timer->m_nextNode = m_slots[slot];
+    if(m_slots[slot]) {
+        m_slots[slot]->m_prev = timer;
+    }
+    m_slots[slot] = timer;
+    timer->m_slot = slot;
+    ++m_size;
+}
+
+void TimerWheel::add(Timer::ptr timer) {
+    Timer* t = timer.get();
+    uint64_t expire = t->m_next < m_current ? m_current : t->m_next;
+    uint64_t delta = expire - m_current;
+    int slot = 0;
+    if(delta < (uint64_t)LEVEL0_SIZE) {
+        slot = expire & (LEVEL0_SIZE - 1);
+    } else {
+        int level = 1;
+        int shift = LEVEL0_BITS;
+        while(level < LEVELS && delta >= (1ull << (shift + LEVEL_BITS))) {
+            ++level;
+            shift += LEVEL_BITS;
+        }
+        if(level == LEVELS) {     //超出范围，先放在最高层，到时候再重新级联，
+            level = LEVELS - 1;
+            shift -= LEVEL_BITS;
+            expire = m_current + (1ull << (shift + LEVEL_BITS)) - 1;
+        }
+        slot = LEVEL0_SIZE + (level - 1) * LEVEL_SIZE
+                + ((expire >> shift) & (LEVEL_SIZE - 1));
+    }
+    t->m_self = std::move(timer);
+    link(t, slot);
+}
+
+void TimerWheel::remove(Timer* timer) {
+    if(timer->m_slot < 0) {
+        return;
+    }
+    if(timer->m_prev) {
+        timer->m_prev->m_nextNode = timer->m_nextNode;
+    } else {
+        m_slots[timer->m_slot] = timer->m_nextNode;
+    }
+    if(timer->m_nextNode) {
+        timer->m_nextNode->m_prev = timer->m_prev;
+    }
+    timer->m_prev = nullptr;
+    timer->m_nextNode = nullptr;
+    timer->m_slot = -1;
+    --m_size;
+    Timer::ptr self;
+    self.swap(timer->m_self);    //最后才释放，调用者可能只持有这一个引用，
+}
+
+//把高层的一个槽里的定时器重新按到期时间放到低层，
+void TimerWheel::cascade(int level) {
+    int shift = LEVEL0_BITS + (level - 1) * LEVEL_BITS;
+    int slot = LEVEL0_SIZE + (level - 1) * LEVEL_SIZE
+                + ((m_current >> shift) & (LEVEL_SIZE - 1));
+    Timer* t = m_slots[slot];
+    m_slots[slot] = nullptr;
+    while(t) {
+        Timer* next = t->m_nextNode;
+        t->m_prev = nullptr;
+        t->m_nextNode = nullptr;
+        t->m_slot = -1;
+        --m_size;
+        Timer::ptr self;
+        self.swap(t->m_self);
+        add(std::move(self));
+        t = next;
+    }
+}
+
+void TimerWheel::clear(std::vector<Timer::ptr>& timers, uint64_t now_ms) {
+    for(int i = 0; i < SLOTS; ++i) {
+        Timer* t = m_slots[i];
+        m_slots[i] = nullptr;
+        while(t) {
+            Timer* next = t->m_nextNode;
+            t->m_prev = nullptr;
+            t->m_nextNode = nullptr;
+            t->m_slot = -1;
+            timers.push_back(nullptr);
+            timers.back().swap(t->m_self);
+            t = next;
+        }
+    }
+    m_size = 0;
+    m_current = now_ms;
+}
+
+void TimerWheel::rebuild(uint64_t now_ms) {
+    std::vector<Timer::ptr> timers;
+    clear(timers, now_ms);
+    for(auto& i : timers) {
+        add(std::move(i));
+    }
+}
+
+void TimerWheel::advance(uint64_t now_ms, std::vector<Timer::ptr>& expired) {
+    if(now_ms < m_current) {
+        return;
+    }
+    if(m_size == 0) {
+        m_current = now_ms + 1;
+        return;
+    }
+    //很久没有推进了，一个tick一个tick地走太慢，直接重新放一遍，
+    if(now_ms - m_current > (1ull << (LEVEL0_BITS + 2 * LEVEL_BITS))) {
+        rebuild(now_ms);
+    }
+    while(m_current <= now_ms) {
+        int idx = m_current & (LEVEL0_SIZE - 1);
+        if(idx == 0) {
+            for(int level = 1; level < LEVELS; ++level) {
+                cascade(level);
+                int shift = LEVEL0_BITS + (level - 1) * LEVEL_BITS;
+                if((m_current >> shift) & (LEVEL_SIZE - 1)) {
+                    break;
+                }
+            }
+        }
+        Timer* t = m_slots[idx];
+        m_slots[idx] = nullptr;
+        while(t) {
+            Timer* next = t->m_nextNode;
+            t->m_prev = nullptr;
+            t->m_nextNode = nullptr;
+            t->m_slot = -1;
+            --m_size;
+            expired.push_back(nullptr);
+            expired.back().swap(t->m_self);
+            t = next;
+        }
+        ++m_current;
+    }
+}
+
+uint64_t TimerWheel::nextExpire() const {
+    if(m_size == 0) {
+        return ~0ull;
+    }
+    //只看第0层到本轮结束，更高层的定时器最早在下一轮开始时级联下来，
+    int idx = m_current & (LEVEL0_SIZE - 1);
+    if(idx == 0) {
+        return m_current;     //这一轮还没有级联，高层可能有这一轮到期的定时器，
+    }
+    for(int i = idx; i < LEVEL0_SIZE; ++i) {
+        if(m_slots[i]) {
+            return m_current + (i - idx);
+        }
+    }
+    return m_current + (LEVEL0_SIZE - idx);
+}
+
+TimerManager::TimerManager(size_t shards) {
+    if(shards == 0) {
+        shards = 1;
+    }
+    uint64_t now_ms = sylar::GetCurrentMS();
+    const std::string& backend = g_timer_backend->getValue();
+    bool use_wheel = backend == "wheel";
+    if(!use_wheel && backend != "set") {
+        SYLAR_LOG_ERROR(g_logger) << "unknown timer.backend=" << backend << ", use set";
+    }
+    for(size_t i = 0; i < shards; ++i) {
+        Shard* shard = new Shard();
+        shard->previousTimer = now_ms;
+        if(use_wheel) {
+            shard->wheel = new TimerWheel(now_ms);
+        }
+        m_shards.push_back(shard);
+    }
 }
 
 TimerManager::~TimerManager() {
+    for(auto& shard : m_shards) {
+        {
+            MutexType::Lock lock(shard->mutex);
+            drainMailbox(shard);
+        }
+        if(shard->wheel) {
+            delete shard->wheel;
+        }
+        delete shard;
+    }
 }
 
-void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock& lock) {
-    auto it = m_timers.insert(val).first; //set集合的insert方法的返回值是一个pair对象，first是一个iterator，指向插入的element，
-                                               //第second是一个bool值，表示是否插入成功， 
-    
-    bool at_front = (it == m_timers.begin()) && !m_tickled;  //如果新插入的timer，排在m_timers的最前面，那么说明，新插入的timer即将执行最快，
+TimerManager::Shard* TimerManager::currentShard() {
+    int idx = timerShardIndex();
+    if(idx < 0 || idx >= (int)m_shards.size()) {
+        return nullptr;
+    }
+    return m_shards[idx];
+}
+
+bool TimerManager::insertTimer(Shard* shard, const Timer::ptr& timer) {
+    uint64_t next = timer->m_next;
+    if(!shard->wheel) {
+        shard->timers.insert(timer);
+        shard->size = shard->timers.size();
+    } else {
+        shard->wheel->add(timer);
+        shard->size = shard->wheel->size();
+    }
+    if(next < shard->nextHint) {
+        shard->nextHint = next;
+        return true;
+    }
+    return false;
+}
+
+bool TimerManager::removeTimer(Shard* shard, const Timer::ptr& timer) {
+    if(!shard->wheel) {
+        auto it = shard->timers.find(timer);
+        if(it == shard->timers.end()) {
+            return false;
+        }
+        shard->timers.erase(it);
+        shard->size = shard->timers.size();
+        return true;
+    }
+    if(timer->m_slot < 0) {
+        return false;
+    }
+    shard->wheel->remove(timer.get());
+    shard->size = shard->wheel->size();
+    return true;
+}
+
+void TimerManager::takeExpired(Shard* shard, uint64_t now_ms, bool rollover, std::vector<Timer::ptr>& expired) {
+    if(shard->wheel) {
+        if(rollover) {     //时间被往回调了，所有定时器都算到期，和set的处理一样，
+            shard->wheel->clear(expired, now_ms);
+        } else {
+            shard->wheel->advance(now_ms, expired);
+        }
+        shard->size = shard->wheel->size();
+        return;
+    }
+    auto& timers = shard->timers;
+    if(timers.empty() || (!rollover && ((*timers.begin())->m_next > now_ms))) {
+        return ;
+    }
+
+    Timer::ptr now_timer(new Timer(now_ms));
+    auto it = rollover ? timers.end() : timers.lower_bound(now_timer);
+    while(it != timers.end() && (*it)->m_next == now_ms) {
+        ++it;
+    }
+    expired.insert(expired.begin(), timers.begin(), it);
+    timers.erase(timers.begin(), it);
+    shard->size = timers.size();
+}
+
+void TimerManager::drainMailbox(Shard* shard) {
+    Timer* timer = shard->mailbox.exchange(nullptr, std::memory_order_acquire);
+    while(timer) {
+        Timer* next = timer->m_mailNext;
+        timer->m_mailNext = nullptr;
+        Timer::ptr self;
+        self.swap(timer->m_mailRef);
+        removeTimer(shard, self);    //可能已经被takeExpired取出来了，
+        timer->m_cb = nullptr;
+        timer = next;
+    }
+}
+
+uint64_t TimerManager::updateHint(Shard* shard) {
+    uint64_t next = ~0ull;
+    if(shard->wheel) {
+        next = shard->wheel->nextExpire();
+    } else if(!shard->timers.empty()) {
+        next = (*shard->timers.begin())->m_next;
+    }
+    shard->nextHint = next;
+    return next;
+}
+
+void TimerManager::cancelTimer(Timer* timer) {
+    Shard* shard = m_shards[timer->m_shard];
+    if(currentShard() == shard) {    //自己分片的定时器，直接删除，
+        Task cb;
+        MutexType::Lock lock(shard->mutex);
+        cb.swap(timer->m_cb);
+        removeTimer(shard, timer->shared_from_this());
+        lock.unlock();
+        return;
+    }
+    //其他线程的分片，放进无锁栈，等持有分片锁的线程删除，
+    timer->m_mailRef = timer->shared_from_this();
+    Timer* head = shard->mailbox.load(std::memory_order_relaxed);
+    do {
+        timer->m_mailNext = head;
+    } while(!shard->mailbox.compare_exchange_weak(head, timer
+                    ,std::memory_order_release, std::memory_order_relaxed));
+}
+
+void TimerManager::addTimer(Shard* shard, Timer::ptr val, MutexType::Lock& lock) {
+    bool at_front = insertTimer(shard, val) && !shard->tickled;  //如果新插入的timer，排在最前面，那么说明，新插入的timer即将执行最快，
     if(at_front) {
-        m_tickled = true;
+        shard->tickled = true;
     }
     lock.unlock();
     if(at_front) {
@@ -113,101 +461,188 @@ void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock& lock) {
     }
 }
 
-Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb,
-                        bool recurring = false) {
-    Timer::ptr timer(new Timer(ms, cb, recurring, this));
-    RWMutexType::WriteLock lock(m_mutex);
+Timer::ptr TimerManager::addTimer(uint64_t ms, Task cb,
+                        bool recurring) {
+    return addTimer(ms, std::move(cb), recurring, 0);
+}
+
+Timer::ptr TimerManager::addTimer(uint64_t ms, Task cb,
+                        bool recurring, uint32_t slack) {
+    Timer::ptr timer(new Timer(ms, std::move(cb), recurring, this, slack));
+    int idx = timerShardIndex();
+    if(idx < 0 || idx >= (int)m_shards.size()) {
+        idx = m_nextShard++ % m_shards.size();    //外部线程创建的定时器，轮流放到各个分片，
+    }
+    timer->m_shard = idx;
+    Shard* shard = m_shards[idx];
+    MutexType::Lock lock(shard->mutex);
     
-    addTimer(timer, lock);
+    addTimer(shard, timer, lock);
 
     return timer;
 }
 
-bool TimerManager::detectClockRollover(uint64_t now_ms) {
+bool TimerManager::detectClockRollover(Shard* shard, uint64_t now_ms) {
     bool rollover = false;
-    if(now_ms < m_previousTimer
-        && now_ms < (m_previousTimer - 60*60*1000)) {
+    if(now_ms < shard->previousTimer
+        && now_ms < (shard->previousTimer - 60*60*1000)) {
             rollover = true;
         }
-    m_previousTimer = now_ms;
+    shard->previousTimer = now_ms;
     return rollover;
  }
 
 
 
-static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb) {
-    std::shared_ptr<void> tmp = weak_cond.lock();
-    if(tmp) {   //只有条件满足的情况下，定时器时间到了才能触发cb函数，
-        cb();
+//Task不能拷贝，不能再用std::bind，
+struct OnTimer {
+    std::weak_ptr<void> weak_cond;
+    mutable Task cb;
+
+    OnTimer(std::weak_ptr<void> cond, Task&& f)
+        :weak_cond(std::move(cond))
+        ,cb(std::move(f)) {
     }
-}
+    OnTimer(OnTimer&& other) = default;
+    //循环条件定时器每次触发拷贝一份，回调也跟着拷贝，
+    OnTimer(const OnTimer& other)
+        :weak_cond(other.weak_cond)
+        ,cb(other.cb.copy()) {
+    }
+
+    void operator()() {
+        std::shared_ptr<void> tmp = weak_cond.lock();
+        if(tmp) {   //只有条件满足的情况下，定时器时间到了才能触发cb函数，
+            cb();
+        }
+    }
+};
         //条件定时器，需要条件满足才能触发，
-Timer::ptr TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb
+Timer::ptr TimerManager::addConditionTimer(uint64_t ms, Task cb
                                 ,std::weak_ptr<void> weak_cond
                                 ,bool recurring) {
-    return addTimer(ms, std::bind(&OnTimer, weak_cond, cb) , recurring);
+    return addTimer(ms, OnTimer{weak_cond, std::move(cb)} , recurring
+                    ,s_coalesce_slack_ms.load(std::memory_order_relaxed));
 }
 
 
 uint64_t TimerManager::getNextTimer() {
-    RWMutexType::Readlock lock(m_mutex);
-    m_tickled = false;
-    if(m_timers.empty()) {
+    Shard* self = currentShard();
+    uint64_t next = ~0ull;
+    for(auto& shard : m_shards) {
+        if(shard->tickled.load(std::memory_order_relaxed)) {
+            shard->tickled = false;
+        }
+        uint64_t hint = 0;
+        if(shard == self) {     //自己的分片顺便清理一下取消的定时器，算出精确的时间，
+            MutexType::Lock lock(shard->mutex);
+            drainMailbox(shard);
+            hint = updateHint(shard);
+        } else {
+            hint = shard->nextHint;
+        }
+        if(hint < next) {
+            next = hint;
+        }
+    }
+    if(next == ~0ull) {
         return ~0ull;   // unsigned long long类型的0 ，～将所有位取反，   得到一个很大的数值，
     }
 
-    const Timer::ptr& next = *m_timers.begin();
     uint64_t now_ms = sylar::GetCurrentMS();
-    if(now_ms >= next->m_next) {
+    if(now_ms >= next) {
         return 0;
     } else {
-        return next->m_next - now_ms;
+        return next - now_ms;
     }
 }
 
-void TimerManager::listExpiredCb(std::vector<std::function<void()> >& cbs) {
-    uint64_t now_ms = sylar::GetCurrentMS();
+void TimerManager::processShard(Shard* shard, uint64_t now_ms, std::vector<Task>& cbs) {
+    drainMailbox(shard);
+    bool rollover = detectClockRollover(shard, now_ms);
     std::vector<Timer::ptr> expired;
-    
-    {
-        RWMutexType::Readlock lock(m_mutex);
-        if(m_timers.empty()) {
-            return;
-        }
+    takeExpired(shard, now_ms, rollover, expired);
+    if(expired.empty()) {
+        updateHint(shard);
+        return;
     }
-    RWMutexType::WriteLock lock1(m_mutex);
-
-    bool rollover = detectClockRollover(now_ms);
-    if(!rollover && ((*m_timers.begin())->m_next > now_ms)) {
-        return ;
-    }
-
-    Timer::ptr now_timer(new Timer(now_ms));
-    auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer);
-    while(it != m_timers.end() && (*it)->m_next == now_ms) {
-        ++it;
-    }
-    expired.insert(expired.begin(), m_timers.begin(), it);
-    m_timers.erase(m_timers.begin(), it);
-    cbs.reserve(expired.size());
-
+    cbs.reserve(cbs.size() + expired.size());
 
+    //expired是按到期时间排好序的，合并定时器到期时间相同的连在一起，
+    std::vector<Task> group;
+    uint64_t group_next = 0;
     for(auto& timer : expired) {
-        cbs.push_back(timer->m_cb);
+        Task cb;
+        uint64_t next = timer->m_next;
         if(timer->m_recurring) {
-            timer->m_next = now_ms + timer->m_ms;
-            m_timers.insert(timer);
+            if(timer->m_state != Timer::ACTIVE) {    //其他线程刚取消，还在无锁栈里，
+                continue;
+            }
+            cb = timer->m_cb.copy();    //每次触发一份独立的拷贝，和原来拷贝std::function一样，
+            timer->setNext(now_ms + timer->m_ms);
+            insertTimer(shard, timer);
         } else {
-            timer->m_cb = nullptr;
+            int expected = Timer::ACTIVE;
+            if(!timer->m_state.compare_exchange_strong(expected, Timer::FIRED)) {
+                continue;
+            }
+            cb.swap(timer->m_cb);
+        }
+        if(!timer->m_slack) {
+            cbs.push_back(std::move(cb));
+            continue;
         }
+        if(!group.empty() && group_next != next) {
+            flushGroup(group, cbs);
+        }
+        group_next = next;
+        group.push_back(std::move(cb));
     }
+    flushGroup(group, cbs);
+    updateHint(shard);
+}
 
+void TimerManager::flushGroup(std::vector<Task>& group, std::vector<Task>& cbs) {
+    if(group.size() == 1) {
+        cbs.push_back(std::move(group[0]));
+    } else if(!group.empty()) {
+        CoalescedCb batch;
+        batch.cbs.swap(group);
+        cbs.push_back(std::move(batch));
+    }
+    group.clear();
+}
 
+void TimerManager::listExpiredCb(std::vector<Task>& cbs) {
+    if(!hasTimer()) {
+        return;
+    }
+    uint64_t now_ms = sylar::GetCurrentMS();
+    Shard* self = currentShard();
+    if(self) {
+        MutexType::Lock lock(self->mutex);
+        processShard(self, now_ms, cbs);
+    }
+    //其他分片的线程可能在忙，有到期的就帮忙处理，别人正在处理就跳过，
+    for(auto& shard : m_shards) {
+        if(shard == self || shard->nextHint > now_ms) {
+            continue;
+        }
+        if(!shard->mutex.trylock()) {
+            continue;
+        }
+        processShard(shard, now_ms, cbs);
+        shard->mutex.unlock();
+    }
 }
 
 bool TimerManager::hasTimer() {
-    RWMutexType::Readlock lock(m_mutex);
-    return m_timers.empty();
+    for(auto& shard : m_shards) {
+        if(shard->size > 0) {
+            return true;
+        }
+    }
+    return false;
 }
 
 
@@ -4,7 +4,9 @@
 #include<memory>
 #include "thread.h"
 #include <set>
+#include <atomic>
 #include "util.h"
+#include "task.h"
 
 
 //定时器功能，
@@ -13,61 +15,156 @@ namespace sylar {
 
 
 class TimerManager;
+class TimerWheel;
 class Timer : public std::enable_shared_from_this<Timer> {
 friend class TimerManager;
+friend class TimerWheel;
 public:
     typedef std::shared_ptr<Timer> ptr;
 
+    //可以在任意线程调用，不是所属分片的线程调用时不加锁，交给所属分片处理，
     bool cancel();
     bool refresh();
     bool reset(uint64_t ms, bool from_now);
 private:
-    Timer(uint64_t ms, std::function<void()> cb,
-            bool recurring, TimerManager* manager);
+    Timer(uint64_t ms, Task cb,
+            bool recurring, TimerManager* manager, uint32_t slack = 0);
 
     Timer(uint64_t next);
 
+    //设置到期时间，合并定时器会向上取整到m_slack的整数倍，
+    void setNext(uint64_t next);
+
+    enum State {
+        ACTIVE = 0,     //等待到期
+        CANCELLED = 1,  //已经取消
+        FIRED = 2       //非循环定时器已经触发
+    };
+
 private:
     bool m_recurring = false;   //是否循环定时器
     uint64_t m_ms = 0;         //执行周期，
     uint64_t m_next = 0;       //精确的执行时间，
     TimerManager* m_manager = nullptr;
-    std::function<void()> m_cb;
-private:    
+    Task m_cb;
+    std::atomic<int> m_state = {ACTIVE};
+    int m_shard = 0;           //所属分片，创建后不再改变
+    uint32_t m_slack = 0;      //合并的粒度(毫秒)，0表示不合并
+
+    //时间轮的侵入式双向链表，挂在时间轮上时m_self持有自己，
+    Timer* m_prev = nullptr;
+    Timer* m_nextNode = nullptr;
+    Timer::ptr m_self;
+    int m_slot = -1;           //所在的槽，-1表示不在时间轮上
+
+    //其他线程取消时挂到所属分片的无锁栈上，m_mailRef保证处理之前不被释放，
+    Timer* m_mailNext = nullptr;
+    Timer::ptr m_mailRef;
+private:
     struct Comparator {
         bool operator() (const Timer::ptr& lhs, const Timer::ptr& rhs) const;
     };
 };
 
+//分层时间轮，精度1ms，第0层256个槽，之后每层64个槽，共5层，覆盖2^32ms(约49天)，
+//插入和删除都是O(1)，不需要分配节点，
+class TimerWheel {
+public:
+    static const int LEVEL0_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int LEVELS = 5;
+    static const int LEVEL0_SIZE = 1 << LEVEL0_BITS;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int SLOTS = LEVEL0_SIZE + (LEVELS - 1) * LEVEL_SIZE;
+
+    TimerWheel(uint64_t now_ms);
+    ~TimerWheel();
+
+    void add(Timer::ptr timer);
+    void remove(Timer* timer);
+    //把所有m_next <= now_ms的定时器取出来，
+    void advance(uint64_t now_ms, std::vector<Timer::ptr>& expired);
+    //取出所有定时器，并把当前时间设置为now_ms
+    void clear(std::vector<Timer::ptr>& timers, uint64_t now_ms);
+    //最近一个可能到期的时间，只会比真实的到期时间早(早了会重新级联)，没有定时器返回~0ull
+    uint64_t nextExpire() const;
+
+    size_t size() const { return m_size;}
+    bool empty() const { return m_size == 0;}
+private:
+    void link(Timer* timer, int slot);
+    void cascade(int level);
+    void rebuild(uint64_t now_ms);
+private:
+    Timer* m_slots[SLOTS];
+    uint64_t m_current;     //下一个要处理的tick(毫秒)
+    size_t m_size = 0;
+};
+
+//定时器按创建的线程分片，每个工作线程只处理自己分片的定时器，不同线程之间不抢同一把锁，
+//其他线程取消定时器时不加锁，把定时器放进分片的无锁栈里，由持有分片锁的线程统一删除，
 class TimerManager {
 friend class Timer;
 public:
-    typedef RWMutex RWMutexType;
+    typedef Spinlock MutexType;
 
-    TimerManager();
+    //shards为分片数，一般等于工作线程数，
+    TimerManager(size_t shards = 1);
     virtual ~TimerManager();
 
-    Timer::ptr addTimer(uint64_t ms, std::function<void()> cb,
+    //循环定时器每次触发执行cb的一份拷贝，
+    Timer::ptr addTimer(uint64_t ms, Task cb,
                         bool recurring = false);
 
         //条件定时器，需要条件满足才能触发，
-    Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb
+    //timer.coalesce_slack_ms不为0时，到期时间会推迟到slack的整数倍，同一批到期的合并成一个任务，
+    Timer::ptr addConditionTimer(uint64_t ms, Task cb
                                 ,std::weak_ptr<void> weak_cond
                                 ,bool recurring = false);
+    //所有分片里最近一个定时器还有多久到期，只有当前线程的分片是精确计算的，
     uint64_t getNextTimer();
-    void listExpiredCb(std::vector<std::function<void()> >& cbs);
-    uint64_t getNextTimer();
+    //先处理当前线程的分片，其他分片有到期的定时器并且没人在处理时顺便处理，
+    //循环定时器每次触发返回回调的一份拷贝，回调只能move不能拷贝时，每次返回的Task共享同一份状态，
+    void listExpiredCb(std::vector<Task>& cbs);
 protected:
     virtual void onTimeInsertedAtFront() = 0;
-    void addTimer(Timer::ptr val, RWMutexType::WriteLock& lock);
+    //当前线程拥有的分片下标，-1表示不是工作线程，新定时器轮流放到各个分片，
+    virtual int timerShardIndex() { return 0;}
     bool hasTimer();
 private:
-    bool detectClockRollover(uint64_t now_ms);
+    struct Shard {
+        MutexType mutex;
+        std::set<Timer::ptr, Timer::Comparator> timers;
+        TimerWheel* wheel = nullptr;           //timer.backend为wheel时使用，
+        //最早到期时间，只会比真实值早，修改要持有mutex，读不用加锁，
+        std::atomic<uint64_t> nextHint = {~0ull};
+        std::atomic<size_t> size = {0};
+        std::atomic<Timer*> mailbox = {nullptr};   //其他线程取消的定时器
+        std::atomic<bool> tickled = {false};
+        uint64_t previousTimer = 0;
+    };
+
+    Timer::ptr addTimer(uint64_t ms, Task cb, bool recurring, uint32_t slack);
+    //把一批合并定时器的回调包成一个Task放进cbs，
+    static void flushGroup(std::vector<Task>& group, std::vector<Task>& cbs);
+    Shard* currentShard();
+    bool detectClockRollover(Shard* shard, uint64_t now_ms);
+    void cancelTimer(Timer* timer);
+    //下面的函数都要在持有分片mutex的时候调用，根据timer.backend操作set或者时间轮，
+    void addTimer(Shard* shard, Timer::ptr val, MutexType::Lock& lock);
+    //插入定时器，返回是否比之前最早的定时器还早，
+    bool insertTimer(Shard* shard, const Timer::ptr& timer);
+    //从容器中移除，不在容器中返回false
+    bool removeTimer(Shard* shard, const Timer::ptr& timer);
+    void takeExpired(Shard* shard, uint64_t now_ms, bool rollover, std::vector<Timer::ptr>& expired);
+    //删除其他线程取消的定时器，
+    void drainMailbox(Shard* shard);
+    //重新计算nextHint和size
+    uint64_t updateHint(Shard* shard);
+    void processShard(Shard* shard, uint64_t now_ms, std::vector<Task>& cbs);
 private:
-    RWMutexType m_mutex;
-    std::set<Timer::ptr, Timer::Comparator> m_timers;
-    bool m_tickled = false;
-    uint64_t m_previousTimer = 0;
+    std::vector<Shard*> m_shards;
+    std::atomic<size_t> m_nextShard = {0};
 };
 
 
@@ -78,4 +175,4 @@ private:
 
 
 
-#endif
\ No newline at end of file
+#endif
@@ -1,6 +1,8 @@
 #include "util.h"
 
 #include <execinfo.h>
+#include <sched.h>
+#include <linux/mempolicy.h>
 #include "log.h"
 #include "fiber.h"
 
@@ -60,5 +62,59 @@ uint64_t GetCurrentUS() {
     return tv.tv_sec *1000* 1000ul +tv.tv_usec;
 }
 
+uint64_t GetCurrentNS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ul * 1000 * 1000 + ts.tv_nsec;
+}
+
+bool SetThreadAffinity(int cpu) {
+    if(cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int rt = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if(rt) {
+        SYLAR_LOG_ERROR(g_logger) << "pthread_setaffinity_np cpu=" << cpu
+            << " rt=" << rt << " errstr=" << strerror(rt);
+        return false;
+    }
+    return true;
+}
+
+int GetCpuId() {
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if(syscall(SYS_getcpu, &cpu, &node, nullptr)) {
+        return -1;
+    }
+    return cpu;
+}
+
+int GetNumaNode() {
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if(syscall(SYS_getcpu, &cpu, &node, nullptr)) {
+        return -1;
+    }
+    return node;
+}
+
+bool BindToLocalNode(void* addr, size_t len) {
+    int node = GetNumaNode();
+    if(node < 0 || node >= (int)(sizeof(unsigned long) * 8)) {
+        return false;
+    }
+    //没有链接libnuma，直接调用系统调用，MPOL_PREFERRED在本节点内存不够时还能从其他节点分配，
+    unsigned long mask = 1ul << node;
+    if(syscall(SYS_mbind, addr, len, MPOL_PREFERRED, &mask
+                , sizeof(mask) * 8, 0)) {
+        return false;
+    }
+    return true;
+}
+
 
 };
\ No newline at end of file
@@ -24,6 +24,17 @@ std::string BacktraceToString(int size = 64, int skip = 2, const std::string& pr
 //时间，
 uint64_t GetCurrentMS();
 uint64_t GetCurrentUS();
+//单调时钟，纳秒，只用来计算时间间隔，
+uint64_t GetCurrentNS();
+
+//cpu亲和性和numa，
+//把当前线程绑定到cpu上，
+bool SetThreadAffinity(int cpu);
+//当前线程正在运行的cpu和所在的numa节点，失败返回-1
+int GetCpuId();
+int GetNumaNode();
+//让[addr, addr + len)的物理内存优先分配在当前线程所在的numa节点上，addr要按页对齐，
+bool BindToLocalNode(void* addr, size_t len);
 
 }
 
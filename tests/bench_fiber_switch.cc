@@ -0,0 +1,71 @@
+#include "sylar/sylar.h"
+#include "sylar/fiber_context.h"
+#include <ucontext.h>
+
+//比较协程切换的开销：当前的FiberContext实现(asm或者ucontext) vs 直接调用swapcontext，
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const size_t s_stack_size = 128 * 1024;
+static uint64_t s_loops = 1000000;
+
+static sylar::FiberContext s_main_ctx;
+static sylar::FiberContext s_fiber_ctx;
+
+static void context_func() {
+    while(true) {
+        sylar::SwapFiberContext(&s_fiber_ctx, &s_main_ctx);
+    }
+}
+
+static ucontext_t s_main_uctx;
+static ucontext_t s_fiber_uctx;
+
+static void ucontext_func() {
+    while(true) {
+        swapcontext(&s_fiber_uctx, &s_main_uctx);
+    }
+}
+
+void bench_context() {
+    void* stack = malloc(s_stack_size);
+    sylar::InitFiberContext(&s_main_ctx);
+    sylar::MakeFiberContext(&s_fiber_ctx, stack, s_stack_size, &context_func);
+
+    uint64_t start = sylar::GetCurrentUS();
+    for(uint64_t i = 0; i < s_loops; ++i) {
+        sylar::SwapFiberContext(&s_main_ctx, &s_fiber_ctx);
+    }
+    uint64_t used = sylar::GetCurrentUS() - start;
+    SYLAR_LOG_INFO(g_logger) << "FiberContext(" << sylar::FiberContextBackend()
+        << ") loops=" << s_loops << " used=" << used << "us "
+        << (used * 1000.0 / s_loops / 2) << "ns/switch";
+    free(stack);
+}
+
+void bench_ucontext() {
+    void* stack = malloc(s_stack_size);
+    getcontext(&s_fiber_uctx);
+    s_fiber_uctx.uc_link = nullptr;
+    s_fiber_uctx.uc_stack.ss_sp = stack;
+    s_fiber_uctx.uc_stack.ss_size = s_stack_size;
+    makecontext(&s_fiber_uctx, &ucontext_func, 0);
+
+    uint64_t start = sylar::GetCurrentUS();
+    for(uint64_t i = 0; i < s_loops; ++i) {
+        swapcontext(&s_main_uctx, &s_fiber_uctx);
+    }
+    uint64_t used = sylar::GetCurrentUS() - start;
+    SYLAR_LOG_INFO(g_logger) << "swapcontext loops=" << s_loops
+        << " used=" << used << "us "
+        << (used * 1000.0 / s_loops / 2) << "ns/switch";
+    free(stack);
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        s_loops = atoll(argv[1]);
+    }
+    bench_ucontext();
+    bench_context();
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include "sylar/sylar.h"
+#include "sylar/tcp_server.h"
+#include "sylar/http/http_server.h"
+#include "sylar/http/http_connection.h"
+
+//比较iomanager.backend为epoll和io_uring时，echo和http服务的吞吐，
+//用法: bench_io_backend [epoll|io_uring|both] [连接数] [每个连接的请求数]
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static int s_threads = 4;
+static int s_conns = 64;
+static int s_requests = 2000;
+
+static sylar::ConfigVar<std::string>::ptr g_backend =
+    sylar::Config::Lookup<std::string>("iomanager.backend", "epoll", "iomanager io backend, epoll or io_uring");
+
+class EchoServer : public sylar::TcpServer {
+public:
+    EchoServer(sylar::IOManager* iom)
+        :TcpServer(iom, iom) {
+    }
+protected:
+    void handleClient(sylar::Socket::ptr client) override {
+        char buf[4096];
+        while(true) {
+            int rt = client->recv(buf, sizeof(buf));
+            if(rt <= 0) {
+                break;
+            }
+            if(client->send(buf, rt) != rt) {
+                break;
+            }
+        }
+        client->close();
+    }
+};
+
+struct BenchState {
+    std::atomic<int> done = {0};
+    std::atomic<uint64_t> requests = {0};
+    uint64_t start = 0;
+    uint64_t used = 0;
+};
+
+static void report(const std::string& name, const std::string& backend, BenchState& st) {
+    SYLAR_LOG_INFO(g_logger) << name << " backend=" << backend
+        << " conns=" << s_conns << " requests=" << st.requests
+        << " used=" << st.used / 1000 << "ms qps="
+        << (st.used ? st.requests * 1000000 / st.used : 0);
+}
+
+//客户端全部结束之后停掉服务，
+static void finish(BenchState& st, sylar::TcpServer::ptr server) {
+    if(++st.done == s_conns) {
+        st.used = sylar::GetCurrentUS() - st.start;
+        server->stop();
+    }
+}
+
+void echo_client(sylar::Address::ptr addr, BenchState* st, sylar::TcpServer::ptr server) {
+    sylar::Socket::ptr sock = sylar::Socket::CreateTCP(addr);
+    if(sock->connect(addr)) {
+        char buf[64] = {'x'};
+        for(int i = 0; i < s_requests; ++i) {
+            if(sock->send(buf, sizeof(buf)) != sizeof(buf)) {
+                break;
+            }
+            int n = 0;
+            while(n < (int)sizeof(buf)) {
+                int rt = sock->recv(buf + n, sizeof(buf) - n);
+                if(rt <= 0) {
+                    break;
+                }
+                n += rt;
+            }
+            if(n != sizeof(buf)) {
+                break;
+            }
+            ++st->requests;
+        }
+        sock->close();
+    }
+    finish(*st, server);
+}
+
+void http_client(sylar::Address::ptr addr, BenchState* st, sylar::TcpServer::ptr server) {
+    sylar::Socket::ptr sock = sylar::Socket::CreateTCP(addr);
+    if(sock->connect(addr)) {
+        sylar::http::HttpConnection::ptr conn(new sylar::http::HttpConnection(sock));
+        for(int i = 0; i < s_requests; ++i) {
+            sylar::http::HttpRequest::ptr req(new sylar::http::HttpRequest(0x11, false));
+            req->setPath("/bench");
+            req->setHeader("Host", "127.0.0.1");
+            if(conn->sendRequest(req) <= 0) {
+                break;
+            }
+            auto rsp = conn->recvResponse();
+            if(!rsp) {
+                break;
+            }
+            ++st->requests;
+        }
+    }
+    finish(*st, server);
+}
+
+void bench_echo(const std::string& backend) {
+    g_backend->setValue(backend);
+    BenchState st;
+    {
+        sylar::IOManager iom(s_threads, false, "echo");
+        sylar::TcpServer::ptr server(new EchoServer(&iom));
+        auto addr = sylar::Address::LookupAny("127.0.0.1:8030");
+        SYLAR_ASSERT(server->bind(addr));
+        server->start();
+        st.start = sylar::GetCurrentUS();
+        for(int i = 0; i < s_conns; ++i) {
+            iom.schedule(std::bind(&echo_client, addr, &st, server));
+        }
+    }
+    report("echo", backend, st);
+}
+
+void bench_http(const std::string& backend) {
+    g_backend->setValue(backend);
+    BenchState st;
+    {
+        sylar::IOManager iom(s_threads, false, "http");
+        sylar::http::HttpServer::ptr server(new sylar::http::HttpServer(true, &iom, &iom));
+        server->getServletDispatch()->addServelt("/bench", [](sylar::http::HttpRequest::ptr req
+                    ,sylar::http::HttpResponse::ptr rsp
+                    ,sylar::http::HttpSession::ptr session) {
+            rsp->setBody("ok");
+            return 0;
+        });
+        auto addr = sylar::Address::LookupAny("127.0.0.1:8031");
+        SYLAR_ASSERT(server->bind(addr));
+        server->start();
+        st.start = sylar::GetCurrentUS();
+        for(int i = 0; i < s_conns; ++i) {
+            iom.schedule(std::bind(&http_client, addr, &st, server));
+        }
+    }
+    report("http", backend, st);
+}
+
+int main(int argc, char** argv) {
+    std::string backend = argc > 1 ? argv[1] : "both";
+    if(argc > 2) {
+        s_conns = atoi(argv[2]);
+    }
+    if(argc > 3) {
+        s_requests = atoi(argv[3]);
+    }
+    std::vector<std::string> backends;
+    if(backend == "both") {
+        backends = {"epoll", "io_uring"};
+    } else {
+        backends.push_back(backend);
+    }
+    for(auto& i : backends) {
+        bench_echo(i);
+        bench_http(i);
+    }
+    return 0;
+}
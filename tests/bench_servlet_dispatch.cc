@@ -0,0 +1,137 @@
+#include "sylar/sylar.h"
+#include "sylar/http/http_servlet.h"
+#include <fnmatch.h>
+
+//1000条路由下比较查找开销: 原来的ServletDispatch(写锁 + unordered_map + 逐个fnmatch) vs 基数树快照，
+//用法: bench_servlet_dispatch [线程数] [每个线程的查找次数]
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static int s_threads = 4;
+static uint64_t s_loops = 1000000;
+static const int ROUTES = 1000;
+
+class NamedServlet : public sylar::http::Servlet {
+public:
+    NamedServlet(const std::string& name)
+        :Servlet(name) {
+    }
+    int32_t handle(sylar::http::HttpRequest::ptr request
+                    , sylar::http::HttpResponse::ptr response
+                    , sylar::http::HttpSession::ptr session) override {
+        return 0;
+    }
+};
+
+//原来的查找方式，
+class LegacyDispatch {
+public:
+    void addServlet(const std::string& uri, sylar::http::Servlet::ptr slt) {
+        sylar::RWMutex::WriteLock lock(m_mutex);
+        m_datas[uri] = slt;
+    }
+    void addGlobServlet(const std::string& uri, sylar::http::Servlet::ptr slt) {
+        sylar::RWMutex::WriteLock lock(m_mutex);
+        m_globs.push_back(std::make_pair(uri, slt));
+    }
+    sylar::http::Servlet::ptr getMatchedServlet(const std::string& uri) {
+        sylar::RWMutex::WriteLock lock(m_mutex);
+        auto mit = m_datas.find(uri);
+        if(mit != m_datas.end()) {
+            return mit->second;
+        }
+        for(auto& i : m_globs) {
+            if(!fnmatch(i.first.c_str(), uri.c_str(), 0)) {
+                return i.second;
+            }
+        }
+        return m_default;
+    }
+private:
+    sylar::RWMutex m_mutex;
+    std::unordered_map<std::string, sylar::http::Servlet::ptr> m_datas;
+    std::vector<std::pair<std::string, sylar::http::Servlet::ptr> > m_globs;
+    sylar::http::Servlet::ptr m_default;
+};
+
+//70%精确路由，20%前缀，10%带参数(原来的方式用等价的glob)，
+static void add_routes(LegacyDispatch& legacy, sylar::http::ServletDispatch& dispatch) {
+    for(int i = 0; i < ROUTES; ++i) {
+        std::string n = std::to_string(i);
+        sylar::http::Servlet::ptr slt(new NamedServlet("route" + n));
+        if(i % 10 < 7) {
+            legacy.addServlet("/api/v1/res" + n + "/item", slt);
+            dispatch.addServelt("/api/v1/res" + n + "/item", slt);
+        } else if(i % 10 < 9) {
+            legacy.addGlobServlet("/static" + n + "/*", slt);
+            dispatch.addGlobServlet("/static" + n + "/*", slt);
+        } else {
+            legacy.addGlobServlet("/user" + n + "/*/profile", slt);
+            dispatch.addServelt("/user" + n + "/:id/profile", slt);
+        }
+    }
+}
+
+static std::vector<std::string> make_paths() {
+    std::vector<std::string> paths;
+    for(int i = 0; i < 4096; ++i) {
+        int r = (i * 7919) % ROUTES;
+        std::string n = std::to_string(r);
+        if(r % 10 < 7) {
+            paths.push_back("/api/v1/res" + n + "/item");
+        } else if(r % 10 < 9) {
+            paths.push_back("/static" + n + "/css/site.css");
+        } else {
+            paths.push_back("/user" + n + "/" + std::to_string(i) + "/profile");
+        }
+    }
+    return paths;
+}
+
+template<class Fn>
+static void run(const std::string& name, Fn fn) {
+    std::vector<sylar::Thread::ptr> thrs;
+    uint64_t start = sylar::GetCurrentUS();
+    for(int i = 0; i < s_threads; ++i) {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread(fn, name + "_" + std::to_string(i))));
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+    uint64_t used = sylar::GetCurrentUS() - start;
+    uint64_t total = s_loops * s_threads;
+    SYLAR_LOG_INFO(g_logger) << name << " threads=" << s_threads << " lookups=" << total
+        << " used=" << used / 1000 << "ms " << (used * 1000.0 / s_loops) << "ns/lookup(per thread) "
+        << (used ? total / used : 0) << "M lookups/s";
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        s_threads = atoi(argv[1]);
+    }
+    if(argc > 2) {
+        s_loops = atoll(argv[2]);
+    }
+    LegacyDispatch legacy;
+    sylar::http::ServletDispatch dispatch;
+    add_routes(legacy, dispatch);
+    std::vector<std::string> paths = make_paths();
+
+    //路由之间没有重叠，两种方式的结果应该一样，
+    for(auto& p : paths) {
+        SYLAR_ASSERT(legacy.getMatchedServlet(p) == dispatch.getMatchedServelt(p));
+    }
+
+    run("legacy", [&legacy, &paths](){
+        for(uint64_t i = 0; i < s_loops; ++i) {
+            legacy.getMatchedServlet(paths[i & 4095]);
+        }
+    });
+    run("radix", [&dispatch, &paths](){
+        std::vector<std::pair<std::string, std::string> > params;
+        for(uint64_t i = 0; i < s_loops; ++i) {
+            params.clear();
+            dispatch.getMatchedServelt(paths[i & 4095], &params);
+        }
+    });
+    return 0;
+}
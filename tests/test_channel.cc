@@ -0,0 +1,73 @@
+#include "sylar/sylar.h"
+#include "sylar/channel.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+//两级流水线: 生产者 -> 平方 -> 求和，通道容量很小，协程会频繁在push/pop上挂起，
+void test_pipeline() {
+    static const int ITEMS = 20000;
+    static const int WORKERS = 4;
+    sylar::Channel<int> input(16);
+    sylar::Channel<int64_t> output(16);
+    std::atomic<int> workers = {WORKERS};
+    int64_t sum = 0;
+    {
+        //用IOManager，协程都挂起时工作线程在idle里等，不会退出，构造时已经start，
+        sylar::IOManager sc(4, false, "channel");
+        sc.schedule([&input](){
+            std::vector<int> batch;
+            for(int i = 1; i <= ITEMS; ++i) {
+                batch.push_back(i);
+                if(batch.size() == 10) {
+                    SYLAR_ASSERT(input.pushBatch(batch) == 10);
+                    batch.clear();
+                }
+            }
+            input.close();
+        });
+        for(int i = 0; i < WORKERS; ++i) {
+            sc.schedule([&](){
+                int v = 0;
+                while(input.pop(v)) {
+                    SYLAR_ASSERT(output.push((int64_t)v * v));
+                }
+                if(--workers == 0) {
+                    output.close();
+                }
+            });
+        }
+        sc.schedule([&output, &sum](){
+            std::vector<int64_t> vals;
+            while(output.popBatch(vals, 32)) {
+                for(auto i : vals) {
+                    sum += i;
+                }
+                vals.clear();
+            }
+        });
+        sc.stop();
+    }
+    int64_t expect = (int64_t)ITEMS * (ITEMS + 1) * (2 * ITEMS + 1) / 6;
+    SYLAR_ASSERT(sum == expect);
+    SYLAR_LOG_INFO(g_logger) << "channel pipeline sum=" << sum << " ok";
+}
+
+void test_try() {
+    sylar::Channel<std::string> ch(2);
+    SYLAR_ASSERT(ch.tryPush("a"));
+    SYLAR_ASSERT(ch.tryPush("b"));
+    SYLAR_ASSERT(!ch.tryPush("c"));
+    std::string v;
+    SYLAR_ASSERT(ch.tryPop(v) && v == "a");
+    ch.close();
+    SYLAR_ASSERT(!ch.push("d"));
+    SYLAR_ASSERT(ch.pop(v) && v == "b");   //关闭之后剩下的还能取出来，
+    SYLAR_ASSERT(!ch.pop(v));
+    SYLAR_LOG_INFO(g_logger) << "channel try ok";
+}
+
+int main(int argc, char** argv) {
+    test_try();
+    test_pipeline();
+    return 0;
+}
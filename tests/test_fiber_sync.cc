@@ -0,0 +1,107 @@
+#include "sylar/sylar.h"
+#include "sylar/fiber_sync.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+//临界区里让出协程，其他协程只能在FiberMutex上挂起，工作线程不阻塞，
+void test_mutex() {
+    static const int FIBERS = 100;
+    static const int LOOPS = 100;
+    sylar::FiberMutex mutex;
+    int counter = 0;
+    {
+        //用IOManager，协程都挂起时工作线程在idle里等，不会退出，构造时已经start，
+        sylar::IOManager sc(4, false, "mutex");
+        for(int i = 0; i < FIBERS; ++i) {
+            sc.schedule([&mutex, &counter](){
+                for(int j = 0; j < LOOPS; ++j) {
+                    sylar::FiberMutex::Lock lock(mutex);
+                    int v = counter;
+                    sylar::Fiber::YieldToReady();
+                    counter = v + 1;
+                }
+            });
+        }
+        sc.stop();
+    }
+    SYLAR_ASSERT(counter == FIBERS * LOOPS);
+    SYLAR_LOG_INFO(g_logger) << "fiber mutex counter=" << counter << " ok";
+}
+
+//生产者和消费者通过条件变量交接，
+void test_condvar() {
+    static const int ITEMS = 10000;
+    sylar::FiberMutex mutex;
+    sylar::FiberCondVar cond;
+    std::deque<int> queue;
+    bool done = false;
+    int64_t sum = 0;
+    {
+        sylar::IOManager sc(4, false, "condvar");
+        for(int i = 0; i < 4; ++i) {
+            sc.schedule([&](){
+                while(true) {
+                    sylar::FiberMutex::Lock lock(mutex);
+                    while(queue.empty() && !done) {
+                        cond.wait(mutex);
+                    }
+                    if(queue.empty()) {
+                        break;
+                    }
+                    sum += queue.front();
+                    queue.pop_front();
+                }
+            });
+        }
+        sc.schedule([&](){
+            for(int i = 1; i <= ITEMS; ++i) {
+                {
+                    sylar::FiberMutex::Lock lock(mutex);
+                    queue.push_back(i);
+                }
+                cond.notify_one();
+            }
+            {
+                sylar::FiberMutex::Lock lock(mutex);
+                done = true;
+            }
+            cond.notify_all();
+        });
+        sc.stop();
+    }
+    SYLAR_ASSERT(sum == (int64_t)ITEMS * (ITEMS + 1) / 2);
+    SYLAR_LOG_INFO(g_logger) << "fiber condvar sum=" << sum << " ok";
+}
+
+//信号量限制同时在临界区里的协程数，
+void test_semaphore() {
+    static const int LIMIT = 3;
+    sylar::FiberSemaphore sem(LIMIT);
+    std::atomic<int> inside = {0};
+    std::atomic<int> max_inside = {0};
+    {
+        sylar::IOManager sc(4, false, "semaphore");
+        for(int i = 0; i < 50; ++i) {
+            sc.schedule([&](){
+                sem.wait();
+                int n = ++inside;
+                int m = max_inside;
+                while(n > m && !max_inside.compare_exchange_weak(m, n));
+                sylar::Fiber::YieldToReady();
+                --inside;
+                sem.notify();
+            });
+        }
+        sc.stop();
+    }
+    SYLAR_ASSERT(max_inside <= LIMIT);
+    SYLAR_ASSERT(sem.getCount() == LIMIT);
+    SYLAR_LOG_INFO(g_logger) << "fiber semaphore max_inside=" << max_inside << " ok";
+}
+
+int main(int argc, char** argv) {
+    test_mutex();
+    test_condvar();
+    test_semaphore();
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include "sylar/sylar.h"
+#include "sylar/histogram.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+void test_record() {
+    sylar::Histogram h;
+    for(uint64_t i = 1; i <= 1000; ++i) {
+        h.record(i);
+    }
+    SYLAR_ASSERT(h.count() == 1000);
+    SYLAR_ASSERT(h.min() == 1 && h.max() == 1000);
+    //相对误差不超过1/16
+    uint64_t p50 = h.percentile(50);
+    uint64_t p99 = h.percentile(99);
+    SYLAR_ASSERT(p50 >= 500 && p50 <= 500 + 500 / 16);
+    SYLAR_ASSERT(p99 >= 990 && p99 <= 1000);
+
+    std::stringstream ss;
+    h.dump(ss);
+    SYLAR_LOG_INFO(g_logger) << ss.str();
+    SYLAR_LOG_INFO(g_logger) << h.toJson();
+}
+
+void test_merge() {
+    sylar::Histogram a;
+    sylar::Histogram b;
+    a.record(10);
+    b.record(1ull << 40);
+    sylar::Histogram m;
+    m.merge(a);
+    m.merge(b);
+    SYLAR_ASSERT(m.count() == 2);
+    SYLAR_ASSERT(m.min() == 10 && m.max() == (1ull << 40));
+    m.reset();
+    SYLAR_ASSERT(m.count() == 0 && m.percentile(99) == 0);
+    SYLAR_LOG_INFO(g_logger) << "test_merge ok";
+}
+
+int main(int argc, char** argv) {
+    test_record();
+    test_merge();
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include "sylar/http/http.h"
 #include "sylar/log.h"
+#include "sylar/macro.h"
 
 
 void test_request() {
@@ -19,9 +20,40 @@ void test_response() {
     rsp->dump(std::cout) << std::endl;   
 }
 
+//serializeHeader加上body，去掉自动加的date头之后应该和dump输出的一样，
+void test_serialize() {
+    sylar::http::HttpResponse::ptr rsp(new sylar::http::HttpResponse());
+    rsp->setHeader("x-x", "sylar");
+    rsp->setBody("hello sylar");
+    rsp->setClose(false);
+    std::string out;
+    rsp->serializeHeader(out);
+    out += rsp->getBody();
+    size_t date = out.find("date: ");
+    SYLAR_ASSERT(date != std::string::npos);
+    out.erase(date, out.find("\r\n", date) + 2 - date);
+    SYLAR_ASSERT(out == rsp->toString());
+    SYLAR_ASSERT(out.compare(0, 17, "HTTP/1.1 200 OK\r\n") == 0);
+
+    rsp->setStatus((sylar::http::HttpStatus)404);
+    rsp->setVersion(0x10);
+    out.clear();
+    rsp->serializeHeader(out);
+    SYLAR_ASSERT(out.compare(0, 24, "HTTP/1.0 404 Not Found\r\n") == 0);
+    rsp->setStatus(sylar::http::HttpStatus::OK);
+    rsp->setVersion(0x11);
+
+    rsp->setBody("");
+    out.clear();
+    rsp->serializeHeader(out);
+    SYLAR_ASSERT(out.find("content-length: 0\r\n\r\n") != std::string::npos);
+    std::cout << out << std::endl;
+}
+
 int main(int argc, char** argv) {
 
 
     test_request();
+    test_serialize();
     return 0;
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "sylar/http/http_parser.h"
 #include "sylar/log.h"
+#include "sylar/macro.h"
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
@@ -22,6 +23,30 @@ void test_request() {
     SYLAR_LOG_INFO(g_logger) << parser.getData()->toString();
 }
 
+//同一个parser解析两个请求，第二次reset之后复用上一个请求对象，
+void test_reset() {
+    sylar::http::HttpRequestParser parser;
+    std::string tmp = "GET /first?a=1 HTTP/1.1\r\nHost: a\r\n\r\n";
+    parser.execute(&tmp[0], tmp.size());
+    SYLAR_ASSERT(parser.isFinished() && !parser.hasError());
+    SYLAR_ASSERT(parser.getData()->getPath() == "/first");
+    sylar::http::HttpRequest* first = parser.getData().get();
+
+    parser.reset();
+    tmp = "GET /second HTTP/1.1\r\nHost: b\r\n\r\n";
+    parser.execute(&tmp[0], tmp.size());
+    SYLAR_ASSERT(parser.isFinished() && !parser.hasError());
+    SYLAR_ASSERT(parser.getData().get() == first);
+    SYLAR_ASSERT(parser.getData()->getPath() == "/second");
+    SYLAR_ASSERT(parser.getData()->getQuery().empty());
+    SYLAR_ASSERT(parser.getData()->getHeader("host") == "b");
+
+    sylar::http::HttpRequest::ptr held = parser.getData();
+    parser.reset();         //上一个请求还被持有，要新建，
+    SYLAR_ASSERT(parser.getData() != held);
+    SYLAR_LOG_INFO(g_logger) << "parser reset ok";
+}
+
 const char test_response_data[] = "HTTP/1.1 200 OK\r\n"
         "Date: Tue, 04 Jun 2019 15:43:56 GMT\r\n"
         "Server: Apache\r\n"
@@ -57,6 +82,7 @@ void test_response() {
 int main(int argc, char** argv) {
     test_request();
     SYLAR_LOG_INFO(g_logger) << "-----------------";
+    test_reset();
 
     return 0;
 }
\ No newline at end of file
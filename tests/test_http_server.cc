@@ -1,5 +1,6 @@
 #include "sylar/http/http_server.h"
 #include "sylar/log.h"
+#include "sylar/macro.h"
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
@@ -18,7 +19,7 @@ void run() {
                             return 0;
     });
 
-    sd->addGlobServelt("/sylar/*", [](sylar::http::HttpRequest::ptr req,
+    sd->addGlobServlet("/sylar/*", [](sylar::http::HttpRequest::ptr req,
                                 sylar::http::HttpResponse::ptr rsp,
                                 sylar::http::HttpSession::ptr session){
                             rsp->setBody("Glob:\r\n" + req->toString());
@@ -29,7 +30,48 @@ void run() {
     server->start();
 }
 
+//一次发出三个请求(pipelining)，三个响应要按顺序回来，
+void run_pipeline() {
+    sylar::http::HttpServer::ptr server(new sylar::http::HttpServer(true));
+    sylar::Address::ptr addr = sylar::Address::LookupAny("127.0.0.1:8021");
+    SYLAR_ASSERT(server->bind(addr));
+    server->getServletDispatch()->addGlobServlet("/p/*", [](sylar::http::HttpRequest::ptr req,
+                                sylar::http::HttpResponse::ptr rsp,
+                                sylar::http::HttpSession::ptr session){
+                            rsp->setBody(req->getPath());
+                            return 0;
+    });
+    server->start();
+
+    sylar::Socket::ptr sock = sylar::Socket::CreateTCP(addr);
+    SYLAR_ASSERT(sock->connect(addr));
+    std::string reqs = "GET /p/1 HTTP/1.1\r\nHost: a\r\n\r\n"
+                       "POST /p/2 HTTP/1.1\r\nHost: a\r\ncontent-length: 3\r\n\r\nabc"
+                       "GET /p/3 HTTP/1.1\r\nHost: a\r\n\r\n";
+    SYLAR_ASSERT(sock->send(reqs.c_str(), reqs.size()) == (int)reqs.size());
+
+    std::string rsps;
+    char buf[4096];
+    while(rsps.find("/p/3") == std::string::npos) {
+        int rt = sock->recv(buf, sizeof(buf));
+        SYLAR_ASSERT(rt > 0);
+        rsps.append(buf, rt);
+    }
+    size_t p1 = rsps.find("/p/1");
+    size_t p2 = rsps.find("/p/2");
+    size_t p3 = rsps.find("/p/3");
+    SYLAR_ASSERT(p1 < p2 && p2 < p3);
+    SYLAR_LOG_INFO(g_logger) << "pipeline ok";
+    sock->close();
+    server->stop();
+}
+
 int main(int argc, char** argv) {
+    if(argc > 1 && std::string(argv[1]) == "pipeline") {
+        sylar::IOManager iom(2);
+        iom.schedule(run_pipeline);
+        return 0;
+    }
     sylar::IOManager iom(0);
     iom.schedule(run);
     return 0;
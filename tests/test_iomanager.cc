@@ -57,11 +57,49 @@ void test_2() {
     }, true);
 }
 
+//持久注册时，fd只在第一次addEvent时epoll_ctl，之后每次重新等待只改等待者，
+static int s_pipe[2];
+static int s_reads = 0;
+void wait_read() {
+    sylar::IOManager::GetThis()->addEvent(s_pipe[0], sylar::IOManager::READ, [](){
+        char buf[16];
+        while(read(s_pipe[0], buf, sizeof(buf)) > 0);
+        if(++s_reads < 3) {
+            wait_read();
+        } else {
+            sylar::IOManager::GetThis()->cancelAll(s_pipe[0]);
+        }
+    });
+}
+
+void test_persistent() {
+    sylar::Histogram hist;
+    {
+        sylar::IOManager iom(2);
+        pipe(s_pipe);
+        fcntl(s_pipe[0], F_SETFL, O_NONBLOCK);
+        iom.schedule(&wait_read);
+        for(int i = 0; i < 3; ++i) {
+            iom.addTimer(100 * (i + 1), [](){
+                write(s_pipe[1], "x", 1);
+            });
+        }
+        iom.stop();
+        iom.getEventsPerWait(hist);
+    }
+    SYLAR_ASSERT(s_reads == 3);
+    std::stringstream ss;
+    hist.dump(ss);
+    SYLAR_LOG_INFO(g_logger) << "events per wait: " << ss.str();
+    close(s_pipe[0]);
+    close(s_pipe[1]);
+}
 
 int main(int argc, char** argv) {
 
     //test_1();
     test_2();
+    test_persistent();
 
     return 0;
 }
\ No newline at end of file
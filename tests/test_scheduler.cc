@@ -18,5 +18,12 @@ int main(int argc, char **argv){
     SYLAR_LOG_INFO(g_logger) << "schedule";
     sc.schedule(&test_fiber);
     sc.stop();
+
+    sylar::Scheduler::Stats stats;
+    sc.getStats(stats);
+    std::stringstream ss;
+    stats.dump(ss);
+    SYLAR_LOG_INFO(g_logger) << "stats: " << ss.str();
+    SYLAR_LOG_INFO(g_logger) << "stats json: " << stats.toJson();
     return 0;
 }
@@ -0,0 +1,66 @@
+#include "sylar/sylar.h"
+#include "sylar/http/http_servlet.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static sylar::http::Servlet::ptr make_servlet() {
+    return sylar::http::Servlet::ptr(new sylar::http::NotFoundServlet());
+}
+
+//先加入的普通glob要优先于后加入的前缀glob，和原来按顺序fnmatch的结果一样，
+void test_glob_order() {
+    sylar::http::ServletDispatch sd;
+    auto css = make_servlet();
+    auto prefix = make_servlet();
+    auto fast = make_servlet();
+    sd.addGlobServlet("/fast/*", fast);
+    sd.addGlobServlet("/static/*.css", css);
+    sd.addGlobServlet("/static/*", prefix);
+    SYLAR_ASSERT(sd.getMatchedServelt("/fast/a") == fast);
+    SYLAR_ASSERT(sd.getMatchedServelt("/static/site.css") == css);
+    SYLAR_ASSERT(sd.getMatchedServelt("/static/logo.png") == prefix);
+
+    //都放进基数树的前缀glob之间也按加入顺序，不是取最长的，
+    sylar::http::ServletDispatch sd2;
+    auto a = make_servlet();
+    auto ab = make_servlet();
+    auto x = make_servlet();
+    sd2.addGlobServlet("/a/*", a);
+    sd2.addGlobServlet("/a/b/*", ab);
+    sd2.addGlobServlet("/x/y/*", x);
+    sd2.addGlobServlet("/x/*", a);
+    SYLAR_ASSERT(sd2.getMatchedServelt("/a/b/c") == a);
+    SYLAR_ASSERT(sd2.getMatchedServelt("/x/y/z") == x);
+    SYLAR_ASSERT(sd2.getMatchedServelt("/x/z") == a);
+    SYLAR_LOG_INFO(g_logger) << "test_glob_order ok";
+}
+
+//参数名跟着各自的路由，同一个位置不同的名字互不影响，
+void test_param_names() {
+    sylar::http::ServletDispatch sd;
+    auto profile = make_servlet();
+    auto posts = make_servlet();
+    sd.addServelt("/user/:id/profile", profile);
+    sd.addServelt("/user/:uid/posts/:pid", posts);
+    std::vector<std::pair<std::string, std::string> > params;
+    SYLAR_ASSERT(sd.getMatchedServelt("/user/5/profile", &params) == profile);
+    SYLAR_ASSERT(params.size() == 1 && params[0].first == "id" && params[0].second == "5");
+    params.clear();
+    SYLAR_ASSERT(sd.getMatchedServelt("/user/7/posts/9", &params) == posts);
+    SYLAR_ASSERT(params.size() == 2 && params[0].first == "uid" && params[1].first == "pid");
+
+    //只有参数名不同的路由，后加入的覆盖先加入的，
+    auto other = make_servlet();
+    sd.addServelt("/user/:name/profile", other);
+    SYLAR_ASSERT(!sd.getServlet("/user/:id/profile"));
+    params.clear();
+    SYLAR_ASSERT(sd.getMatchedServelt("/user/5/profile", &params) == other);
+    SYLAR_ASSERT(params.size() == 1 && params[0].first == "name");
+    SYLAR_LOG_INFO(g_logger) << "test_param_names ok";
+}
+
+int main(int argc, char** argv) {
+    test_glob_order();
+    test_param_names();
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include "sylar/sylar.h"
+#include "sylar/task.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+void test_inline() {
+    int n = 0;
+    sylar::Task task([&n](){ ++n; });
+    SYLAR_ASSERT(task.isInline());
+    task();
+    SYLAR_ASSERT(n == 1);
+
+    sylar::Task other(std::move(task));
+    SYLAR_ASSERT(!task && other);
+    other();
+    SYLAR_ASSERT(n == 2);
+
+    other = nullptr;
+    SYLAR_ASSERT(other == nullptr);
+    SYLAR_LOG_INFO(g_logger) << "test_inline ok";
+}
+
+void test_heap() {
+    int n = 0;
+    char pad[sylar::Task::INLINE_SIZE] = {1};
+    sylar::Task task([&n, pad](){ n += pad[0]; });
+    SYLAR_ASSERT(!task.isInline());
+    sylar::Task other;
+    other.swap(task);
+    other();
+    SYLAR_ASSERT(!task && n == 1);
+    SYLAR_LOG_INFO(g_logger) << "test_heap ok";
+}
+
+void test_function() {
+    std::function<void()> empty;
+    sylar::Task task(empty);
+    SYLAR_ASSERT(!task);
+
+    auto ptr = std::make_shared<int>(0);
+    {
+        sylar::Task t1(std::bind([](std::shared_ptr<int> p){ ++*p; }, ptr));
+        sylar::Task t2(std::move(t1));
+        SYLAR_ASSERT(ptr.use_count() == 2);
+        t2();
+    }
+    SYLAR_ASSERT(ptr.use_count() == 1 && *ptr == 1);
+    SYLAR_LOG_INFO(g_logger) << "test_function ok";
+}
+
+void test_share() {
+    int n = 0;
+    sylar::Task task([&n](){ ++n; });
+    sylar::Task s1 = task.share();
+    sylar::Task s2 = task.share();
+    s1();
+    s2();
+    task();
+    SYLAR_ASSERT(n == 3);
+    SYLAR_LOG_INFO(g_logger) << "test_share ok";
+}
+
+struct MoveOnly {
+    std::unique_ptr<int> p;
+    void operator()() { ++*p;}
+};
+
+void test_copy() {
+    int n = 0;
+    sylar::Task task([n]() mutable { ++n; SYLAR_ASSERT(n == 1);});
+    sylar::Task c1 = task.copy();
+    sylar::Task c2 = task.copy();
+    c1();
+    c2();   //每份拷贝有自己的n，
+    task();
+
+    //不能拷贝的退化成共享，
+    sylar::Task mo(MoveOnly{std::unique_ptr<int>(new int(0))});
+    sylar::Task s1 = mo.copy();
+    sylar::Task s2 = mo.copy();
+    s1();
+    s2();
+    SYLAR_LOG_INFO(g_logger) << "test_copy ok";
+}
+
+int main(int argc, char** argv) {
+    test_inline();
+    test_heap();
+    test_function();
+    test_share();
+    test_copy();
+    return 0;
+}
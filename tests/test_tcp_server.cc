@@ -22,7 +22,67 @@ void run() {
 }
 
 
+//多reactor模式，每个单线程IOManager有自己的SO_REUSEPORT监听socket，
+void run_reactors(std::vector<sylar::IOManager*> reactors) {
+    auto addr = sylar::Address::LookupAny("0.0.0.0:8033");
+    sylar::TcpServer::ptr tcp_server(new sylar::TcpServer());
+    tcp_server->setReactors(reactors);
+    SYLAR_ASSERT(tcp_server->bind(addr));
+    SYLAR_ASSERT(tcp_server->start());
+}
+
+//保持连接不返回的服务，用来占满max_connections，
+class HoldServer : public sylar::TcpServer {
+protected:
+    void handleClient(sylar::Socket::ptr client) override {
+        char buf[64];
+        while(client->recv(buf, sizeof(buf)) > 0);
+        client->close();
+    }
+};
+
+//max_connections为2时同时连5个，应该有3个被直接关掉，
+void run_admission() {
+    auto addr = sylar::Address::LookupAny("127.0.0.1:8034");
+    sylar::TcpServer::ptr tcp_server(new HoldServer());
+    tcp_server->setMaxConnections(2);
+    SYLAR_ASSERT(tcp_server->bind(addr));
+    tcp_server->start();
+
+    std::vector<sylar::Socket::ptr> clients;
+    for(int i = 0; i < 5; ++i) {
+        sylar::Socket::ptr sock = sylar::Socket::CreateTCP(addr);
+        SYLAR_ASSERT(sock->connect(addr));
+        clients.push_back(sock);
+    }
+    sleep(1);
+    SYLAR_LOG_INFO(g_logger) << "connections=" << tcp_server->getConnectionCount()
+                             << " shed=" << tcp_server->getShedCount();
+    SYLAR_ASSERT(tcp_server->getConnectionCount() == 2);
+    SYLAR_ASSERT(tcp_server->getShedCount() == 3);
+    for(auto& i : clients) {
+        i->close();
+    }
+    tcp_server->stop();
+}
+
 int main(int argc, char** argv) {
+    if(argc > 1 && std::string(argv[1]) == "admission") {
+        sylar::IOManager iom(2);
+        iom.schedule(run_admission);
+        return 0;
+    }
+    if(argc > 1 && std::string(argv[1]) == "reactors") {
+        std::vector<sylar::IOManager*> reactors;
+        for(int i = 0; i < 4; ++i) {
+            reactors.push_back(new sylar::IOManager(1, false, "reactor_" + std::to_string(i)));
+        }
+        run_reactors(reactors);
+        for(auto i : reactors) {
+            delete i;
+        }
+        return 0;
+    }
     sylar::IOManager iom(2);
     iom.schedule(run);
     return 0;
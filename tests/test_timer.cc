@@ -0,0 +1,166 @@
+#include "sylar/sylar.h"
+#include "sylar/timer.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+class TestTimerManager : public sylar::TimerManager {
+public:
+    void onTimeInsertedAtFront() override {}
+
+    //一直等到所有定时器都到期，
+    void runAll() {
+        while(true) {
+            uint64_t next = getNextTimer();
+            if(next == ~0ull) {
+                break;
+            }
+            if(next) {
+                usleep(next * 1000);
+            }
+            std::vector<sylar::Task> cbs;
+            listExpiredCb(cbs);
+            for(auto& i : cbs) {
+                i();
+            }
+        }
+    }
+};
+
+void test_backend(const std::string& backend) {
+    sylar::Config::Lookup<std::string>("timer.backend", "wheel")->setValue(backend);
+    TestTimerManager tm;
+
+    std::vector<int> order;
+    uint64_t start = sylar::GetCurrentMS();
+    int ms[] = {300, 5, 260, 100, 1};
+    for(int i : ms) {
+        tm.addTimer(i, [i, &order, start](){
+            uint64_t used = sylar::GetCurrentMS() - start;
+            SYLAR_ASSERT(used >= (uint64_t)i);
+            order.push_back(i);
+        });
+    }
+    sylar::Timer::ptr cancelled = tm.addTimer(50, [](){
+        SYLAR_ASSERT2(false, "cancelled timer fired");
+    });
+    SYLAR_ASSERT(cancelled->cancel());
+    SYLAR_ASSERT(!cancelled->cancel());
+
+    int count = 0;
+    sylar::Timer::ptr recurring;
+    recurring = tm.addTimer(20, [&count, &recurring](){
+        if(++count == 5) {
+            recurring->cancel();
+        }
+    }, true);
+
+    tm.runAll();
+    SYLAR_ASSERT(count == 5);
+    SYLAR_ASSERT(order.size() == 5);
+    for(size_t i = 1; i < order.size(); ++i) {
+        SYLAR_ASSERT(order[i - 1] < order[i]);
+    }
+    SYLAR_LOG_INFO(g_logger) << "timer backend=" << backend << " ok";
+}
+
+//超时时间不同但落在同一个slack区间的条件定时器，只产生一个任务，
+void test_coalesce() {
+    auto slack = sylar::Config::Lookup<uint32_t>("timer.coalesce_slack_ms", 0);
+    slack->setValue(50);
+    TestTimerManager tm;
+    std::shared_ptr<int> cond(new int(0));
+    int fired = 0;
+    uint64_t start = sylar::GetCurrentMS();
+    for(int i = 0; i < 100; ++i) {
+        tm.addConditionTimer(100 + i % 5, [&fired](){ ++fired; }, cond);
+    }
+
+    size_t tasks = 0;
+    while(fired < 100) {
+        uint64_t next = tm.getNextTimer();
+        SYLAR_ASSERT(next != ~0ull);
+        usleep(next * 1000);
+        std::vector<sylar::Task> cbs;
+        tm.listExpiredCb(cbs);
+        tasks += cbs.size();
+        for(auto& i : cbs) {
+            i();
+        }
+    }
+    SYLAR_ASSERT(sylar::GetCurrentMS() - start >= 100);
+    SYLAR_ASSERT(tasks <= 2);       //开始时间可能跨过一个区间边界，
+    slack->setValue(0);
+    SYLAR_LOG_INFO(g_logger) << "timer coalesce tasks=" << tasks << " ok";
+}
+
+static thread_local int t_shard = -1;
+
+class ShardedTimerManager : public sylar::TimerManager {
+public:
+    ShardedTimerManager(size_t shards)
+        :TimerManager(shards) {
+    }
+    void onTimeInsertedAtFront() override {}
+    int timerShardIndex() override { return t_shard;}
+};
+
+//每个线程往自己的分片加定时器，再取消相邻线程的一半定时器，
+void test_shards() {
+    static const int THREADS = 4;
+    static const int PER = 10000;
+    ShardedTimerManager tm(THREADS);
+    std::vector<sylar::Timer::ptr> timers[THREADS];
+    std::atomic<int> fired = {0};
+    std::atomic<int> cancelled = {0};
+    std::atomic<int> ready = {0};
+    std::atomic<bool> stop = {false};
+
+    std::vector<sylar::Thread::ptr> thrs;
+    for(int i = 0; i < THREADS; ++i) {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread([&, i](){
+            t_shard = i;
+            for(int j = 0; j < PER; ++j) {
+                timers[i].push_back(tm.addTimer(1 + j % 50, [&fired](){ ++fired; }));
+            }
+            ++ready;
+            while(ready < THREADS) {
+                usleep(100);
+            }
+            auto& other = timers[(i + 1) % THREADS];
+            for(int j = 0; j < PER; j += 2) {
+                if(other[j]->cancel()) {
+                    ++cancelled;
+                }
+            }
+            std::vector<sylar::Task> cbs;
+            while(!stop) {
+                tm.getNextTimer();
+                tm.listExpiredCb(cbs);
+                for(auto& cb : cbs) {
+                    cb();
+                }
+                cbs.clear();
+                usleep(200);
+            }
+        }, "timer_" + std::to_string(i))));
+    }
+    for(int i = 0; i < 500 && fired + cancelled < THREADS * PER; ++i) {
+        usleep(10 * 1000);
+    }
+    stop = true;
+    for(auto& i : thrs) {
+        i->join();
+    }
+    SYLAR_ASSERT(fired + cancelled == THREADS * PER);
+    SYLAR_ASSERT(tm.getNextTimer() == ~0ull);
+    SYLAR_LOG_INFO(g_logger) << "timer shards fired=" << fired
+                             << " cancelled=" << cancelled << " ok";
+}
+
+int main(int argc, char** argv) {
+    test_backend("set");
+    test_backend("wheel");
+    test_coalesce();
+    test_shards();
+    return 0;
+}